@@ -0,0 +1,551 @@
+//=============================================================================
+// Agent.cpp
+//
+// Per-host agent of a multi-host capture session, see SessionProtocol.h. It
+// runs next to a Trigger --daemon on every capture host:
+//
+//     Agent <coordinator> [--port p] [--name host] [--control address]
+//     Agent <coordinator> [--port p] [--name host] --simulate n [--fps f]
+//         [--offset-ms o] [--jitter-us j]
+//
+// The agent connects to the coordinator and relays its start and stop
+// commands, with their times, to the local daemon through the control socket
+// as soon as they arrive. Meanwhile it reads the metadata of every frame from
+// the frame buses of the local cameras and sends the frame ID and corrected
+// timestamp of each frame of the session to the coordinator. The daemon
+// saves the frames of the same window, so the coordinator's index lists the
+// recorded frames. No image data leaves the host.
+//
+// With --simulate the agent needs neither cameras nor daemon: it generates
+// the frames of n cameras triggered together at f frames per second, on the
+// wall-clock grid shared by all agents, with a host clock offset of o ms and
+// a per-frame jitter of up to j us. Several simulated agents on one machine
+// behave like hosts on one trigger line.
+//=============================================================================
+
+#include "ControlSocket.h"
+#include "FrameBus.h"
+#include "SessionProtocol.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+// Time the agent waits for the daemon to answer a control request.
+const int k_controlTimeoutMs = 5000;
+
+// Time the agent waits for commands before it polls the frame buses again.
+const int k_agentPollMs = 2;
+
+// This function sends one request to the local daemon and reads its answer.
+int SendControlRequest(const string & controlAddress, const string & request, string & response)
+{
+	socket_t sock = ConnectControlSocket(controlAddress);
+	if (sock == INVALID_SOCKET)
+	{
+		response = "{\"ok\":false,\"error\":\"daemon not reachable\"}";
+		return -1;
+	}
+
+	string buffer;
+	bool answered = SendAll(sock, request + "\n") && WaitReadable(sock, k_controlTimeoutMs) && ReadLine(sock, buffer, response);
+	closesocket(sock);
+	if (!answered)
+	{
+		response = "{\"ok\":false,\"error\":\"no answer from daemon\"}";
+		return -1;
+	}
+	return JsonGetValue(response, "ok") == "true" ? 0 : -1;
+}
+
+// Frames of one camera, read from its frame bus or simulated.
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+	virtual const string & SerialNumber() const = 0;
+
+	// Appends the frames that became available since the last call.
+	virtual void Poll(int64_t now, vector<SessionFrame> & frames) = 0;
+
+	// Frames lost before they could be read.
+	virtual uint64_t Skipped() const = 0;
+};
+
+class FrameBusSource : public FrameSource
+{
+public:
+	explicit FrameBusSource(const string & serialNumber) : m_serialNumber(serialNumber), m_next(0), m_skipped(0), m_reopen(false) {}
+
+	const string & SerialNumber() const { return m_serialNumber; }
+
+	void Poll(int64_t /*now*/, vector<SessionFrame> & frames)
+	{
+		// The daemon replaces the ring whenever it restarts or restarts its
+		// cameras; leave a ring its producer has left and find the new one
+		if (m_reader.Header() != NULL && !m_reader.Live(m_next > m_reader.Published()))
+		{
+			cout << "Frame bus of camera " << m_serialNumber << " closed, reopening..." << endl;
+			m_skipped += m_reader.Skipped();
+			m_reader.Close();
+			m_reopen = true;
+		}
+
+		// The bus exists only while the daemon streams
+		if (m_reader.Header() == NULL)
+		{
+			if (!m_reader.Open(FrameBusName(m_serialNumber)))
+			{
+				return;
+			}
+			if (!m_reader.Live(true))
+			{
+				// Left behind by a daemon that died; it is replaced on restart
+				m_reader.Close();
+				return;
+			}
+			uint64_t published = m_reader.Published();
+			uint32_t slotCount = m_reader.Header()->slotCount;
+			if (!m_reopen)
+			{
+				m_next = published + 1;
+			}
+			else
+			{
+				// Frames of the new ring may already belong to the session
+				m_next = published > slotCount ? published - slotCount + 1 : 1;
+			}
+		}
+
+		uint64_t published = m_reader.Published();
+		for (; m_next <= published; m_next = m_reader.Next(m_next))
+		{
+			const FrameBusSlot * slot = m_reader.Acquire(m_next);
+			if (slot == NULL)
+			{
+				continue;
+			}
+			SessionFrame frame;
+			frame.serialNumber = m_serialNumber;
+			frame.frameId = slot->metadata.frameId;
+			frame.setSequence = slot->setSequence;
+			frame.hostTimestamp = slot->metadata.hostTimestamp;
+			if (m_reader.Release(slot, m_next))
+			{
+				frames.push_back(frame);
+			}
+		}
+	}
+
+	uint64_t Skipped() const { return m_skipped + (m_reader.Header() == NULL ? 0 : m_reader.Skipped()); }
+
+private:
+	string m_serialNumber;
+	FrameBusReader m_reader;
+	uint64_t m_next;
+	uint64_t m_skipped;		// skipped on rings left before
+	bool m_reopen;
+};
+
+class SimulatedSource : public FrameSource
+{
+public:
+	SimulatedSource(const string & serialNumber, double fps, int64_t offsetNs, int64_t jitterNs, unsigned int seed)
+		: m_serialNumber(serialNumber), m_periodNs(static_cast<int64_t>(1e9 / fps)), m_offsetNs(offsetNs), m_jitterNs(jitterNs),
+		m_random(seed), m_nextTrigger(0), m_frameId(0) {}
+
+	const string & SerialNumber() const { return m_serialNumber; }
+
+	void Poll(int64_t now, vector<SessionFrame> & frames)
+	{
+		if (m_nextTrigger == 0)
+		{
+			m_nextTrigger = (now / m_periodNs + 1) * m_periodNs;
+		}
+		uniform_int_distribution<int64_t> jitter(-m_jitterNs, m_jitterNs);
+		for (; m_nextTrigger <= now; m_nextTrigger += m_periodNs)
+		{
+			SessionFrame frame;
+			frame.serialNumber = m_serialNumber;
+			frame.frameId = m_frameId++;
+			frame.setSequence = static_cast<uint64_t>(m_nextTrigger / m_periodNs);
+			frame.hostTimestamp = m_nextTrigger + m_offsetNs + jitter(m_random);
+			frames.push_back(frame);
+		}
+	}
+
+	uint64_t Skipped() const { return 0; }
+
+private:
+	string m_serialNumber;
+	int64_t m_periodNs;
+	int64_t m_offsetNs;
+	int64_t m_jitterNs;
+	mt19937_64 m_random;
+	int64_t m_nextTrigger;
+	uint64_t m_frameId;
+};
+
+// This function lists the serial numbers of the cameras of the local daemon
+// from its stats response.
+int DiscoverCameras(const string & controlAddress, vector<string> & serialNumbers)
+{
+	string response;
+	if (SendControlRequest(controlAddress, "{\"cmd\":\"stats\"}", response) != 0)
+	{
+		cout << "Unable to query the daemon at " << controlAddress << ": " << JsonGetValue(response, "error") << ". Aborting..." << endl;
+		return -1;
+	}
+
+	const string key = "\"serial\"";
+	for (string::size_type pos = response.find(key); pos != string::npos; pos = response.find(key, pos + key.size()))
+	{
+		serialNumbers.push_back(JsonGetValue(response.substr(pos), "serial"));
+	}
+	if (serialNumbers.empty())
+	{
+		cout << "The daemon reports no cameras. Aborting..." << endl;
+		return -1;
+	}
+	return 0;
+}
+
+// This class runs the agent: it follows the commands of the coordinator and
+// streams the frames of the session window to it.
+class SessionAgent
+{
+public:
+	SessionAgent(socket_t coordinator, const string & controlAddress, bool simulate, vector<unique_ptr<FrameSource> > & sources)
+		: m_coordinator(coordinator), m_controlAddress(controlAddress), m_simulate(simulate), m_sources(sources),
+		m_startAt(0), m_stopAt(0), m_recording(false), m_stopping(false), m_drainUntil(0), m_nextBatch(0),
+		m_sessionFrames(0), m_sessionUntimed(0), m_sessionSkipped(0) {}
+
+	int Run()
+	{
+		string buffer;
+		string line;
+		vector<SessionFrame> frames;
+		for (;;)
+		{
+			if (WaitReadable(m_coordinator, k_agentPollMs))
+			{
+				// Handle every complete line, not only the first
+				do
+				{
+					if (!ReadLine(m_coordinator, buffer, line))
+					{
+						cout << "Coordinator closed the connection." << endl;
+						return -1;
+					}
+					if (!HandleCommand(line))
+					{
+						return 0;
+					}
+				} while (buffer.find('\n') != string::npos);
+			}
+
+			int64_t now = WallClockNs();
+
+			// Sources are polled even outside a session so that they never
+			// fall a full ring behind
+			frames.clear();
+			for (size_t i = 0; i < m_sources.size(); i++)
+			{
+				m_sources[i]->Poll(now, frames);
+			}
+			for (size_t i = 0; m_recording && i < frames.size(); i++)
+			{
+				// The same window as the daemon saves, see SessionWindow in
+				// Trigger.cpp
+				const SessionFrame & frame = frames[i];
+				if (frame.hostTimestamp == 0)
+				{
+					m_sessionUntimed++;
+				}
+				else if (frame.hostTimestamp >= m_startAt && (m_stopAt == 0 || frame.hostTimestamp < m_stopAt))
+				{
+					AppendSessionFrame(m_batch, frame);
+					m_sessionFrames++;
+				}
+			}
+
+			if (!m_batch.empty() && (now >= m_nextBatch || m_batch.size() >= k_maxFrameBatchBytes))
+			{
+				if (!SendBatch())
+				{
+					return -1;
+				}
+				m_nextBatch = now + static_cast<int64_t>(k_frameBatchMs) * 1000000;
+			}
+			if (m_stopping && now >= m_drainUntil && !Finish())
+			{
+				return -1;
+			}
+		}
+	}
+
+private:
+	// Returns false on shutdown.
+	bool HandleCommand(const string & line)
+	{
+		string cmd = JsonGetValue(line, "cmd");
+		if (cmd == "start" && !m_recording)
+		{
+			m_sessionName = JsonGetValue(line, "name");
+			m_startAt = atoll(JsonGetValue(line, "at").c_str());
+			m_stopAt = 0;
+			cout << "Session " << m_sessionName << " starts in " << (m_startAt - WallClockNs()) / 1000000 << " ms" << endl;
+			Start();
+		}
+		else if (cmd == "stop" && m_recording && !m_stopping)
+		{
+			m_stopAt = atoll(JsonGetValue(line, "at").c_str());
+			Stop();
+		}
+		else if (cmd == "shutdown")
+		{
+			return false;
+		}
+		return true;
+	}
+
+	// The daemon gets the start and stop times as soon as they arrive, and
+	// saves the frames between them.
+	void Start()
+	{
+		bool ok = true;
+		string error;
+		if (!m_simulate)
+		{
+			ostringstream request;
+			request << "{\"cmd\":\"start\",\"name\":\"" << JsonEscape(m_sessionName) << "\",\"at\":" << m_startAt << "}";
+			string response;
+			ok = SendControlRequest(m_controlAddress, request.str(), response) == 0;
+			error = JsonGetValue(response, "error");
+		}
+
+		// Without a recording on the daemon there is nothing to index; the
+		// coordinator counts the host as stopped
+		m_recording = ok;
+		if (!ok)
+		{
+			m_startAt = 0;
+		}
+		m_sessionFrames = 0;
+		m_sessionUntimed = 0;
+		m_sessionSkipped = 0;
+		for (size_t i = 0; i < m_sources.size(); i++)
+		{
+			m_sessionSkipped -= m_sources[i]->Skipped();
+		}
+
+		ostringstream message;
+		message << "{\"type\":\"started\",\"ok\":" << (ok ? "true" : "false");
+		if (!ok)
+		{
+			message << ",\"error\":\"" << JsonEscape(error) << "\"";
+			cout << "Daemon refused to start: " << error << endl;
+		}
+		message << "}\n";
+		SendAll(m_coordinator, message.str());
+	}
+
+	void Stop()
+	{
+		if (!m_simulate)
+		{
+			ostringstream request;
+			request << "{\"cmd\":\"stop\",\"at\":" << m_stopAt << "}";
+			string response;
+			if (SendControlRequest(m_controlAddress, request.str(), response) != 0)
+			{
+				cout << "Daemon refused to stop: " << JsonGetValue(response, "error") << endl;
+			}
+		}
+		m_stopping = true;
+		m_drainUntil = m_stopAt + k_sessionDrainNs;
+	}
+
+	bool SendBatch()
+	{
+		bool sent = SendAll(m_coordinator, "{\"type\":\"frames\",\"frames\":\"" + m_batch + "\"}\n");
+		m_batch.clear();
+		return sent;
+	}
+
+	// Sends the remaining frames and closes the session.
+	bool Finish()
+	{
+		if (!m_batch.empty() && !SendBatch())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < m_sources.size(); i++)
+		{
+			m_sessionSkipped += m_sources[i]->Skipped();
+		}
+
+		ostringstream message;
+		message << "{\"type\":\"stopped\",\"frames\":" << m_sessionFrames << ",\"skipped\":" << m_sessionSkipped
+			<< ",\"untimed\":" << m_sessionUntimed << "}\n";
+		cout << "Session " << m_sessionName << " stopped: " << m_sessionFrames << " frames sent, " << m_sessionSkipped << " skipped, "
+			<< m_sessionUntimed << " without host timestamp" << endl;
+
+		m_startAt = 0;
+		m_stopAt = 0;
+		m_recording = false;
+		m_stopping = false;
+		return SendAll(m_coordinator, message.str());
+	}
+
+	socket_t m_coordinator;
+	string m_controlAddress;
+	bool m_simulate;
+	vector<unique_ptr<FrameSource> > & m_sources;
+
+	string m_sessionName;
+	int64_t m_startAt;
+	int64_t m_stopAt;
+	bool m_recording;
+	bool m_stopping;
+	int64_t m_drainUntil;
+
+	string m_batch;
+	int64_t m_nextBatch;
+	uint64_t m_sessionFrames;
+	uint64_t m_sessionUntimed;	// left out for lack of a host timestamp
+	uint64_t m_sessionSkipped;
+};
+
+int main(int argc, char** argv)
+{
+	string coordinatorHost;
+	string port = k_defaultCoordinatorPort;
+	string hostName;
+	string controlAddress = k_defaultControlAddress;
+	int simulatedCameras = 0;
+	double fps = 30.0;
+	double offsetMs = 0.0;
+	double jitterUs = 50.0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--port" && i + 1 < argc)
+		{
+			port = argv[++i];
+		}
+		else if (arg == "--name" && i + 1 < argc)
+		{
+			hostName = argv[++i];
+		}
+		else if (arg == "--control" && i + 1 < argc)
+		{
+			controlAddress = argv[++i];
+		}
+		else if (arg == "--simulate" && i + 1 < argc)
+		{
+			simulatedCameras = atoi(argv[++i]);
+		}
+		else if (arg == "--fps" && i + 1 < argc)
+		{
+			fps = atof(argv[++i]);
+		}
+		else if (arg == "--offset-ms" && i + 1 < argc)
+		{
+			offsetMs = atof(argv[++i]);
+		}
+		else if (arg == "--jitter-us" && i + 1 < argc)
+		{
+			jitterUs = atof(argv[++i]);
+		}
+		else if (coordinatorHost.empty())
+		{
+			coordinatorHost = arg;
+		}
+		else
+		{
+			coordinatorHost.clear();
+			break;
+		}
+	}
+
+	if (coordinatorHost.empty() || simulatedCameras < 0 || fps <= 0.0)
+	{
+		cout << "Usage: Agent <coordinator> [--port p] [--name host] [--control address]" << endl;
+		cout << "       Agent <coordinator> [--port p] [--name host] --simulate n [--fps f] [--offset-ms o] [--jitter-us j]" << endl;
+		return -1;
+	}
+
+	if (!InitSockets())
+	{
+		cout << "Unable to initialize sockets. Aborting..." << endl;
+		return -1;
+	}
+	if (hostName.empty())
+	{
+		char name[256] = "";
+		gethostname(name, sizeof(name) - 1);
+		hostName = name;
+	}
+
+	// Cameras of the local daemon, or simulated ones
+	vector<string> serialNumbers;
+	vector<unique_ptr<FrameSource> > sources;
+	if (simulatedCameras > 0)
+	{
+		random_device seed;
+		for (int i = 0; i < simulatedCameras; i++)
+		{
+			ostringstream serialNumber;
+			serialNumber << hostName << "-sim" << i;
+			serialNumbers.push_back(serialNumber.str());
+			sources.push_back(unique_ptr<FrameSource>(new SimulatedSource(serialNumber.str(), fps, static_cast<int64_t>(offsetMs * 1e6),
+				static_cast<int64_t>(jitterUs * 1e3), seed())));
+		}
+	}
+	else
+	{
+		if (DiscoverCameras(controlAddress, serialNumbers) != 0)
+		{
+			CleanupSockets();
+			return -1;
+		}
+		for (size_t i = 0; i < serialNumbers.size(); i++)
+		{
+			sources.push_back(unique_ptr<FrameSource>(new FrameBusSource(serialNumbers[i])));
+		}
+	}
+
+	socket_t coordinator = ConnectTcpSocket(coordinatorHost, port);
+	if (coordinator == INVALID_SOCKET)
+	{
+		cout << "Unable to connect to coordinator " << coordinatorHost << ":" << port << ". Aborting..." << endl;
+		CleanupSockets();
+		return -1;
+	}
+
+	string cameraList;
+	for (size_t i = 0; i < serialNumbers.size(); i++)
+	{
+		cameraList += (i > 0 ? "," : "") + serialNumbers[i];
+	}
+	SendAll(coordinator, "{\"type\":\"hello\",\"host\":\"" + JsonEscape(hostName) + "\",\"cameras\":\"" + JsonEscape(cameraList) + "\"}\n");
+	cout << "Agent " << hostName << " connected to " << coordinatorHost << ":" << port << " with " << serialNumbers.size()
+		<< (simulatedCameras > 0 ? " simulated" : "") << " cameras" << endl;
+
+	SessionAgent agent(coordinator, controlAddress, simulatedCameras > 0, sources);
+	int result = agent.Run();
+
+	closesocket(coordinator);
+	CleanupSockets();
+	return result;
+}
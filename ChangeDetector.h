@@ -0,0 +1,192 @@
+//=============================================================================
+// ChangeDetector.h
+//
+// Frame-difference change detector used by the motion gate of Trigger.cpp.
+// Each 8-bit frame is reduced to a thumbnail with one pixel per
+// k_changeBlockSize x k_changeBlockSize block: two rows of the block are
+// averaged and every 8 columns are summed with SSE2 (pavgb + psadbw). The
+// thumbnail is compared with the one of the previous frame, and the score is
+// the fraction of blocks inside the region mask whose level changed by more
+// than a threshold.
+//=============================================================================
+
+#ifndef CHANGE_DETECTOR_H
+#define CHANGE_DETECTOR_H
+
+#include <stdint.h>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHANGE_DETECTOR_SSE2
+#endif
+
+const unsigned int k_changeBlockSize = 8;
+
+// Rectangle of the frame that takes part in change detection, in fractions
+// of the frame width and height.
+struct ChangeRegion
+{
+	double left;
+	double top;
+	double right;
+	double bottom;
+};
+
+class ChangeDetector
+{
+public:
+	ChangeDetector() : m_width(0), m_height(0), m_pitch(0), m_maskedBlocks(0), m_hasReference(false) {}
+
+	// Forgets the reference frame, e.g. at the start of a session.
+	void Reset()
+	{
+		m_hasReference = false;
+	}
+
+	// Returns the fraction of masked blocks that changed by more than
+	// threshold levels since the previous frame, or 0 for the first frame.
+	// No block can change by more than 255 levels, so a threshold of 255
+	// never reports a change.
+	double Update(const uint8_t * data, unsigned int width, unsigned int height, size_t stride,
+		const ChangeRegion * regions, unsigned int numRegions, uint8_t threshold)
+	{
+		unsigned int thumbWidth = width / k_changeBlockSize;
+		unsigned int thumbHeight = height / k_changeBlockSize;
+		if (thumbWidth != m_width || thumbHeight != m_height)
+		{
+			Resize(thumbWidth, thumbHeight, regions, numRegions);
+		}
+		if (m_maskedBlocks == 0)
+		{
+			return 0.0;
+		}
+
+		Downsample(data, stride);
+
+		double score = 0.0;
+		if (m_hasReference)
+		{
+			score = static_cast<double>(CountChanged(threshold)) / m_maskedBlocks;
+		}
+		m_reference.swap(m_current);
+		m_hasReference = true;
+
+		return score;
+	}
+
+private:
+	// Thumbnail rows are padded to a multiple of 16 bytes so the comparison
+	// needs no tail handling; the padding is masked out.
+	void Resize(unsigned int thumbWidth, unsigned int thumbHeight, const ChangeRegion * regions, unsigned int numRegions)
+	{
+		m_width = thumbWidth;
+		m_height = thumbHeight;
+		m_pitch = (thumbWidth + 15) & ~15u;
+		m_current.assign(m_pitch * m_height, 0);
+		m_reference.assign(m_pitch * m_height, 0);
+		m_mask.assign(m_pitch * m_height, 0);
+		m_hasReference = false;
+
+		m_maskedBlocks = 0;
+		for (unsigned int r = 0; r < numRegions; r++)
+		{
+			unsigned int left = static_cast<unsigned int>(regions[r].left * thumbWidth);
+			unsigned int right = static_cast<unsigned int>(regions[r].right * thumbWidth);
+			unsigned int top = static_cast<unsigned int>(regions[r].top * thumbHeight);
+			unsigned int bottom = static_cast<unsigned int>(regions[r].bottom * thumbHeight);
+			for (unsigned int y = top; y < bottom && y < thumbHeight; y++)
+			{
+				for (unsigned int x = left; x < right && x < thumbWidth; x++)
+				{
+					m_mask[y * m_pitch + x] = 0xFF;
+				}
+			}
+		}
+		for (size_t i = 0; i < m_mask.size(); i++)
+		{
+			m_maskedBlocks += m_mask[i] != 0 ? 1 : 0;
+		}
+	}
+
+	void Downsample(const uint8_t * data, size_t stride)
+	{
+		for (unsigned int y = 0; y < m_height; y++)
+		{
+			const uint8_t * row0 = data + (y * k_changeBlockSize) * stride;
+			const uint8_t * row1 = row0 + (k_changeBlockSize / 2) * stride;
+			uint8_t * thumb = &m_current[y * m_pitch];
+
+			unsigned int x = 0;
+#ifdef CHANGE_DETECTOR_SSE2
+			// Each 16 source bytes yield two block sums of 8 pixels
+			const __m128i zero = _mm_setzero_si128();
+			for (; x + 2 <= m_width; x += 2)
+			{
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * k_changeBlockSize));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * k_changeBlockSize));
+				__m128i sums = _mm_sad_epu8(_mm_avg_epu8(a, b), zero);
+				thumb[x] = static_cast<uint8_t>(_mm_cvtsi128_si32(sums) / k_changeBlockSize);
+				thumb[x + 1] = static_cast<uint8_t>(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)) / k_changeBlockSize);
+			}
+#endif
+			for (; x < m_width; x++)
+			{
+				unsigned int sum = 0;
+				for (unsigned int i = 0; i < k_changeBlockSize; i++)
+				{
+					sum += (row0[x * k_changeBlockSize + i] + row1[x * k_changeBlockSize + i] + 1) / 2;
+				}
+				thumb[x] = static_cast<uint8_t>(sum / k_changeBlockSize);
+			}
+		}
+	}
+
+	unsigned int CountChanged(uint8_t threshold) const
+	{
+		unsigned int changed = 0;
+		size_t i = 0;
+		if (threshold == 255)
+		{
+			// threshold + 1 does not fit in a byte
+			return 0;
+		}
+
+#ifdef CHANGE_DETECTOR_SSE2
+		// |a - b| > threshold  <=>  max(|a - b|, threshold + 1) == |a - b|
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i limit = _mm_set1_epi8(static_cast<char>(threshold + 1));
+		const __m128i one = _mm_set1_epi8(1);
+		__m128i counts = _mm_setzero_si128();
+		for (; i + 16 <= m_current.size(); i += 16)
+		{
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&m_current[i]));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&m_reference[i]));
+			__m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&m_mask[i]));
+			__m128i diff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+			__m128i isChanged = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(diff, limit), diff), mask);
+			counts = _mm_add_epi64(counts, _mm_sad_epu8(_mm_and_si128(isChanged, one), zero));
+		}
+		changed += static_cast<unsigned int>(_mm_cvtsi128_si32(counts) + _mm_cvtsi128_si32(_mm_srli_si128(counts, 8)));
+#endif
+
+		for (; i < m_current.size(); i++)
+		{
+			int diff = static_cast<int>(m_current[i]) - static_cast<int>(m_reference[i]);
+			changed += (m_mask[i] != 0 && (diff > threshold || -diff > threshold)) ? 1 : 0;
+		}
+		return changed;
+	}
+
+	unsigned int m_width;
+	unsigned int m_height;
+	unsigned int m_pitch;
+	unsigned int m_maskedBlocks;
+	bool m_hasReference;
+	std::vector<uint8_t> m_current;
+	std::vector<uint8_t> m_reference;
+	std::vector<uint8_t> m_mask;
+};
+
+#endif // CHANGE_DETECTOR_H
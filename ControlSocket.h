@@ -0,0 +1,392 @@
+//=============================================================================
+// ControlSocket.h
+//
+// Minimal local control channel used by the daemon mode of Trigger.cpp.
+// Clients connect to a Unix domain socket (a loopback TCP port on Windows,
+// where Unix sockets are not available to VS2015 builds) and exchange one
+// JSON object per line. Only the tiny subset of JSON needed by the control
+// protocol is handled here: flat objects with string and number values.
+//
+// The same line protocol runs over TCP between the multi-host coordinator and
+// its agents, so plain TCP listen and connect helpers live here as well.
+//=============================================================================
+
+#ifndef CONTROL_SOCKET_H
+#define CONTROL_SOCKET_H
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET socket_t;
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+// Default control address: a socket path, or a port number on Windows.
+#ifdef _WIN32
+const char * const k_defaultControlAddress = "5555";
+#else
+const char * const k_defaultControlAddress = "/tmp/camerasync.sock";
+#endif
+
+inline bool InitSockets()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+	// A peer that goes away must fail send(), not end the process
+	signal(SIGPIPE, SIG_IGN);
+	return true;
+#endif
+}
+
+inline void CleanupSockets()
+{
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+// Creates a listening socket on the local control address. Fails if another
+// daemon is already listening there. On POSIX, a socket file is only removed
+// when nothing accepts connections on it, i.e. it was left behind by a run
+// that did not shut down cleanly, and the new socket is made accessible to
+// its owner only, since any client of it can control recording. The loopback
+// port used on Windows is bound exclusively, but is open to all local users.
+inline socket_t ListenControlSocket(const std::string & address)
+{
+#ifdef _WIN32
+	socket_t listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == INVALID_SOCKET)
+	{
+		return INVALID_SOCKET;
+	}
+	int exclusive = 1;
+	setsockopt(listener, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, reinterpret_cast<const char *>(&exclusive), sizeof(exclusive));
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(static_cast<u_short>(atoi(address.c_str())));
+#else
+	socket_t listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener == INVALID_SOCKET)
+	{
+		return INVALID_SOCKET;
+	}
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+
+	// Only a refused connection shows that the socket file is stale; a socket
+	// that cannot be reached for any other reason is left alone
+	socket_t probe = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (probe == INVALID_SOCKET)
+	{
+		closesocket(listener);
+		return INVALID_SOCKET;
+	}
+	int probeResult = connect(probe, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+	int probeError = errno;
+	closesocket(probe);
+	if (probeResult == 0)
+	{
+		closesocket(listener);
+		return INVALID_SOCKET;
+	}
+	if (probeError == ECONNREFUSED)
+	{
+		unlink(address.c_str());
+	}
+#endif
+
+	if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+	{
+		closesocket(listener);
+		return INVALID_SOCKET;
+	}
+#ifndef _WIN32
+	// Restricted before listen(), so no client can connect in between
+	if (chmod(address.c_str(), S_IRUSR | S_IWUSR) != 0)
+	{
+		closesocket(listener);
+		unlink(address.c_str());
+		return INVALID_SOCKET;
+	}
+#endif
+	if (listen(listener, 4) != 0)
+	{
+		closesocket(listener);
+#ifndef _WIN32
+		unlink(address.c_str());
+#endif
+		return INVALID_SOCKET;
+	}
+	return listener;
+}
+
+inline void CloseControlSocket(socket_t listener, const std::string & address)
+{
+	closesocket(listener);
+#ifndef _WIN32
+	unlink(address.c_str());
+#else
+	(void)address;
+#endif
+}
+
+// Connects to the local control address of a running daemon.
+inline socket_t ConnectControlSocket(const std::string & address)
+{
+#ifdef _WIN32
+	socket_t sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock == INVALID_SOCKET)
+	{
+		return INVALID_SOCKET;
+	}
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(static_cast<u_short>(atoi(address.c_str())));
+#else
+	socket_t sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock == INVALID_SOCKET)
+	{
+		return INVALID_SOCKET;
+	}
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+#endif
+
+	if (connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+	{
+		closesocket(sock);
+		return INVALID_SOCKET;
+	}
+	return sock;
+}
+
+// Creates a TCP socket listening on all interfaces.
+inline socket_t ListenTcpSocket(unsigned short port)
+{
+	socket_t listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == INVALID_SOCKET)
+	{
+		return INVALID_SOCKET;
+	}
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&reuse), sizeof(reuse));
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listener, 16) != 0)
+	{
+		closesocket(listener);
+		return INVALID_SOCKET;
+	}
+	return listener;
+}
+
+// Connects to a TCP host and port. Nagle is disabled, since the protocol
+// sends short lines that should not wait for more data.
+inline socket_t ConnectTcpSocket(const std::string & host, const std::string & port)
+{
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo * result = NULL;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+	{
+		return INVALID_SOCKET;
+	}
+
+	socket_t sock = INVALID_SOCKET;
+	for (addrinfo * ai = result; ai != NULL && sock == INVALID_SOCKET; ai = ai->ai_next)
+	{
+		sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (sock != INVALID_SOCKET && connect(sock, ai->ai_addr, static_cast<int>(ai->ai_addrlen)) != 0)
+		{
+			closesocket(sock);
+			sock = INVALID_SOCKET;
+		}
+	}
+	freeaddrinfo(result);
+
+	if (sock != INVALID_SOCKET)
+	{
+		int noDelay = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+	}
+	return sock;
+}
+
+// Waits up to timeoutMs for the socket to become readable.
+inline bool WaitReadable(socket_t sock, int timeoutMs)
+{
+	fd_set readSet;
+	FD_ZERO(&readSet);
+	FD_SET(sock, &readSet);
+	timeval timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+	return select(static_cast<int>(sock) + 1, &readSet, NULL, NULL, &timeout) > 0;
+}
+
+// Longest line a peer may send; a peer exceeding it is treated as closed.
+const size_t k_maxLineLength = 65536;
+
+// Reads from the socket until a complete line is buffered. Returns false once
+// the peer has closed the connection or sent a line longer than
+// k_maxLineLength.
+inline bool ReadLine(socket_t sock, std::string & buffer, std::string & line)
+{
+	for (;;)
+	{
+		std::string::size_type newline = buffer.find('\n');
+		if (newline != std::string::npos)
+		{
+			line = buffer.substr(0, newline);
+			buffer.erase(0, newline + 1);
+			if (!line.empty() && line[line.size() - 1] == '\r')
+			{
+				line.erase(line.size() - 1);
+			}
+			return true;
+		}
+
+		if (buffer.size() > k_maxLineLength)
+		{
+			return false;
+		}
+
+		char chunk[512];
+		int received = recv(sock, chunk, sizeof(chunk), 0);
+		if (received <= 0)
+		{
+			return false;
+		}
+		buffer.append(chunk, received);
+	}
+}
+
+inline bool SendAll(socket_t sock, const std::string & data)
+{
+	size_t sent = 0;
+	while (sent < data.size())
+	{
+		int n = send(sock, data.data() + sent, static_cast<int>(data.size() - sent), 0);
+		if (n <= 0)
+		{
+			return false;
+		}
+		sent += n;
+	}
+	return true;
+}
+
+// Returns the raw value of a key in a flat JSON object: the unescaped text of
+// a string value, or the literal text of a number/boolean. Returns an empty
+// string if the key is missing.
+inline std::string JsonGetValue(const std::string & json, const std::string & key)
+{
+	std::string quotedKey = "\"" + key + "\"";
+	std::string::size_type pos = json.find(quotedKey);
+	if (pos == std::string::npos)
+	{
+		return "";
+	}
+	pos = json.find(':', pos + quotedKey.size());
+	if (pos == std::string::npos)
+	{
+		return "";
+	}
+	pos = json.find_first_not_of(" \t", pos + 1);
+	if (pos == std::string::npos)
+	{
+		return "";
+	}
+
+	std::string value;
+	if (json[pos] == '"')
+	{
+		for (pos++; pos < json.size() && json[pos] != '"'; pos++)
+		{
+			if (json[pos] == '\\' && pos + 1 < json.size())
+			{
+				pos++;
+			}
+			value += json[pos];
+		}
+	}
+	else
+	{
+		std::string::size_type end = json.find_first_of(",} \t", pos);
+		value = json.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+	}
+	return value;
+}
+
+// Returns true if a name received from a client is safe to use in a file
+// name: non-empty and only [A-Za-z0-9_-].
+inline bool IsValidName(const std::string & name)
+{
+	if (name.empty())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < name.size(); i++)
+	{
+		char c = name[i];
+		if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '-'))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+inline std::string JsonEscape(const std::string & text)
+{
+	std::string escaped;
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		if (text[i] == '"' || text[i] == '\\')
+		{
+			escaped += '\\';
+		}
+		escaped += text[i];
+	}
+	return escaped;
+}
+
+#endif // CONTROL_SOCKET_H
@@ -0,0 +1,713 @@
+//=============================================================================
+// Coordinator.cpp
+//
+// Central coordinator of a multi-host capture session, see
+// SessionProtocol.h. Every capture host runs an agent (Agent.cpp) that
+// connects here:
+//
+//     Coordinator [--port p] [--tolerance-ms t]
+//     Coordinator [--port p] [--tolerance-ms t] --agents n --record name seconds
+//
+// Interactively, the coordinator reads commands from stdin: "start <name>",
+// "stop", "status" and "quit". With --record it waits for n agents, records
+// one session of the given length and exits, which is how several simulated
+// agents are run against it on one machine.
+//
+// Start and stop go to all agents at once, with a common start and stop
+// time. While recording, the agents stream the frame ID and corrected
+// timestamp of every frame, and the coordinator assigns each frame to a
+// global synchronized set as it arrives. Frames of one host that share a
+// local set stay together; the first frame of a local set joins the global
+// set whose timestamp is within the tolerance and has no frame of that host
+// yet, or opens a new one. When all agents have confirmed the stop, the index
+// is written to <name>.sets.csv, one line per frame in set order, and the
+// complete and incomplete sets and the timestamp spread are reported.
+//=============================================================================
+
+#include "ControlSocket.h"
+#include "SessionProtocol.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+const double k_defaultSetToleranceMs = 2.0;
+
+// Time the coordinator waits for agents to confirm the stop.
+const int64_t k_stopTimeoutNs = 10000000000LL;
+
+// One frame of a global synchronized set.
+struct SetMember
+{
+	unsigned int host;
+	unsigned int camera;
+	uint64_t frameId;
+	uint64_t setSequence;
+	int64_t hostTimestamp;
+};
+
+struct SynchronizedSet
+{
+	int64_t timestamp;			// timestamp of the first frame of the set
+	int64_t minTimestamp;
+	int64_t maxTimestamp;
+	vector<SetMember> members;
+};
+
+// This class builds the global set index of a session. Sets are found by
+// timestamp in an ordered map; the local sets already placed are remembered
+// in a hash map, so that most frames are placed with a single lookup.
+class SetIndex
+{
+public:
+	explicit SetIndex(int64_t toleranceNs) : m_toleranceNs(toleranceNs), m_frames(0) {}
+
+	void Reset()
+	{
+		m_sets.clear();
+		m_byTime.clear();
+		m_byLocalSet.clear();
+		m_frames = 0;
+	}
+
+	void Add(unsigned int host, unsigned int camera, const SessionFrame & frame)
+	{
+		uint64_t localKey = (static_cast<uint64_t>(host) << 48) ^ frame.setSequence;
+		unordered_map<uint64_t, size_t>::iterator local = m_byLocalSet.find(localKey);
+		size_t setIndex = local != m_byLocalSet.end() ? local->second : FindSet(host, frame.hostTimestamp);
+		if (local == m_byLocalSet.end())
+		{
+			m_byLocalSet[localKey] = setIndex;
+		}
+
+		SynchronizedSet & set = m_sets[setIndex];
+		SetMember member;
+		member.host = host;
+		member.camera = camera;
+		member.frameId = frame.frameId;
+		member.setSequence = frame.setSequence;
+		member.hostTimestamp = frame.hostTimestamp;
+		set.members.push_back(member);
+		set.minTimestamp = min(set.minTimestamp, frame.hostTimestamp);
+		set.maxTimestamp = max(set.maxTimestamp, frame.hostTimestamp);
+		m_frames++;
+	}
+
+	// Writes the index in set order and prints its summary. Host and camera
+	// names are indexed by the numbers passed to Add().
+	int Write(const string & path, const vector<string> & hostNames, const vector<vector<string> > & cameraNames) const
+	{
+		FILE * file = fopen(path.c_str(), "w");
+		if (file == NULL)
+		{
+			cout << "Unable to write " << path << "..." << endl;
+			return -1;
+		}
+
+		size_t cameraCount = 0;
+		for (size_t i = 0; i < cameraNames.size(); i++)
+		{
+			cameraCount += cameraNames[i].size();
+		}
+
+		uint64_t completeSets = 0;
+		int64_t maxSpreadNs = 0;
+		double totalSpreadNs = 0.0;
+		uint64_t setNumber = 0;
+
+		fprintf(file, "set,timestamp,host,serial,frame_id,local_set,offset_us\n");
+		for (map<int64_t, size_t>::const_iterator it = m_byTime.begin(); it != m_byTime.end(); ++it, setNumber++)
+		{
+			const SynchronizedSet & set = m_sets[it->second];
+			for (size_t i = 0; i < set.members.size(); i++)
+			{
+				const SetMember & member = set.members[i];
+				fprintf(file, "%llu,%lld,%s,%s,%llu,%llu,%.1f\n", static_cast<unsigned long long>(setNumber), static_cast<long long>(set.timestamp),
+					hostNames[member.host].c_str(), cameraNames[member.host][member.camera].c_str(), static_cast<unsigned long long>(member.frameId),
+					static_cast<unsigned long long>(member.setSequence), (member.hostTimestamp - set.timestamp) / 1000.0);
+			}
+
+			int64_t spreadNs = set.maxTimestamp - set.minTimestamp;
+			completeSets += set.members.size() == cameraCount ? 1 : 0;
+			maxSpreadNs = max(maxSpreadNs, spreadNs);
+			totalSpreadNs += spreadNs;
+		}
+		fclose(file);
+
+		cout << "Wrote " << m_sets.size() << " sets of " << m_frames << " frames from " << cameraCount << " cameras to " << path << endl;
+		cout << "  complete sets: " << completeSets << ", incomplete: " << m_sets.size() - completeSets << endl;
+		cout << "  timestamp spread: mean " << (m_sets.empty() ? 0.0 : totalSpreadNs / m_sets.size() / 1000.0) << " us, max " << maxSpreadNs / 1000.0 << " us" << endl;
+		return 0;
+	}
+
+	size_t Sets() const { return m_sets.size(); }
+	uint64_t Frames() const { return m_frames; }
+
+private:
+	// Returns the set within the tolerance of a timestamp that has no frame
+	// of the host yet, the closest one if there are several, or a new set.
+	size_t FindSet(unsigned int host, int64_t timestamp)
+	{
+		size_t best = m_sets.size();
+		int64_t bestDistance = m_toleranceNs + 1;
+		for (map<int64_t, size_t>::iterator it = m_byTime.lower_bound(timestamp - m_toleranceNs); it != m_byTime.end() && it->first <= timestamp + m_toleranceNs; ++it)
+		{
+			int64_t distance = it->first > timestamp ? it->first - timestamp : timestamp - it->first;
+			if (distance < bestDistance && !HasHost(m_sets[it->second], host))
+			{
+				best = it->second;
+				bestDistance = distance;
+			}
+		}
+		if (best < m_sets.size())
+		{
+			return best;
+		}
+
+		SynchronizedSet set;
+		set.timestamp = timestamp;
+		set.minTimestamp = timestamp;
+		set.maxTimestamp = timestamp;
+		m_sets.push_back(set);
+
+		// Sets opened at the same timestamp keep their own entry
+		int64_t key = timestamp;
+		while (m_byTime.find(key) != m_byTime.end())
+		{
+			key++;
+		}
+		m_byTime[key] = best;
+		return best;
+	}
+
+	static bool HasHost(const SynchronizedSet & set, unsigned int host)
+	{
+		for (size_t i = 0; i < set.members.size(); i++)
+		{
+			if (set.members[i].host == host)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	int64_t m_toleranceNs;
+	vector<SynchronizedSet> m_sets;
+	map<int64_t, size_t> m_byTime;
+	unordered_map<uint64_t, size_t> m_byLocalSet;
+	uint64_t m_frames;
+};
+
+struct AgentConnection
+{
+	socket_t sock;
+	string buffer;
+	string host;
+	vector<string> cameras;
+	bool started;
+	bool stopped;
+	uint64_t frames;
+};
+
+// This class accepts the agents and runs the sessions.
+class SessionCoordinator
+{
+public:
+	SessionCoordinator(socket_t listener, double toleranceMs)
+		: m_listener(listener), m_index(static_cast<int64_t>(toleranceMs * 1e6)), m_recording(false), m_stopping(false), m_stopAt(0) {}
+
+	~SessionCoordinator()
+	{
+		for (size_t i = 0; i < m_agents.size(); i++)
+		{
+			if (m_agents[i].sock != INVALID_SOCKET)
+			{
+				closesocket(m_agents[i].sock);
+			}
+		}
+	}
+
+	// Accepts connections and handles the messages of the agents for up to
+	// timeoutMs.
+	void Poll(int timeoutMs)
+	{
+		fd_set readSet;
+		FD_ZERO(&readSet);
+		FD_SET(m_listener, &readSet);
+		socket_t maxSocket = m_listener;
+		for (size_t i = 0; i < m_agents.size(); i++)
+		{
+			if (m_agents[i].sock != INVALID_SOCKET)
+			{
+				FD_SET(m_agents[i].sock, &readSet);
+				maxSocket = max(maxSocket, m_agents[i].sock);
+			}
+		}
+		timeval timeout;
+		timeout.tv_sec = timeoutMs / 1000;
+		timeout.tv_usec = (timeoutMs % 1000) * 1000;
+		if (select(static_cast<int>(maxSocket) + 1, &readSet, NULL, NULL, &timeout) > 0)
+		{
+			if (FD_ISSET(m_listener, &readSet))
+			{
+				Accept();
+			}
+			for (size_t i = 0; i < m_agents.size(); i++)
+			{
+				if (m_agents[i].sock != INVALID_SOCKET && FD_ISSET(m_agents[i].sock, &readSet))
+				{
+					Receive(static_cast<unsigned int>(i));
+				}
+			}
+		}
+
+		if (m_stopping && (AllStopped() || WallClockNs() > m_stopAt + k_stopTimeoutNs))
+		{
+			FinishSession();
+		}
+	}
+
+	int Start(const string & name)
+	{
+		if (m_recording || m_stopping)
+		{
+			cout << "Already recording session " << m_sessionName << "..." << endl;
+			return -1;
+		}
+		if (ConnectedAgents() == 0)
+		{
+			cout << "No agents connected..." << endl;
+			return -1;
+		}
+		if (!IsValidName(name))
+		{
+			// The daemons use the name as a file prefix
+			cout << "Invalid session name " << name << "..." << endl;
+			return -1;
+		}
+
+		m_sessionName = name;
+		m_index.Reset();
+		int64_t startAt = WallClockNs() + k_sessionLeadNs;
+		for (size_t i = 0; i < m_agents.size(); i++)
+		{
+			m_agents[i].started = false;
+			m_agents[i].stopped = m_agents[i].sock == INVALID_SOCKET;
+			m_agents[i].frames = 0;
+		}
+
+		ostringstream command;
+		command << "{\"cmd\":\"start\",\"name\":\"" << JsonEscape(name) << "\",\"at\":" << startAt << "}\n";
+		Broadcast(command.str());
+		m_recording = true;
+		cout << "Session " << name << " starting on " << ConnectedAgents() << " agents" << endl;
+		return 0;
+	}
+
+	int Stop()
+	{
+		if (!m_recording)
+		{
+			cout << "Not recording..." << endl;
+			return -1;
+		}
+		m_stopAt = WallClockNs() + k_sessionLeadNs;
+		ostringstream command;
+		command << "{\"cmd\":\"stop\",\"at\":" << m_stopAt << "}\n";
+		Broadcast(command.str());
+		m_recording = false;
+		m_stopping = true;
+		cout << "Session " << m_sessionName << " stopping" << endl;
+		return 0;
+	}
+
+	void Shutdown()
+	{
+		Broadcast("{\"cmd\":\"shutdown\"}\n");
+	}
+
+	void PrintStatus() const
+	{
+		cout << ConnectedAgents() << " agents connected";
+		if (m_recording || m_stopping)
+		{
+			cout << ", session " << m_sessionName << (m_recording ? " recording" : " stopping") << ": " << m_index.Frames() << " frames in " << m_index.Sets() << " sets";
+		}
+		cout << endl;
+		for (size_t i = 0; i < m_agents.size(); i++)
+		{
+			if (m_agents[i].sock != INVALID_SOCKET)
+			{
+				cout << "  " << m_agents[i].host << ": " << m_agents[i].cameras.size() << " cameras, " << m_agents[i].frames << " frames" << endl;
+			}
+		}
+	}
+
+	size_t ConnectedAgents() const
+	{
+		size_t connected = 0;
+		for (size_t i = 0; i < m_agents.size(); i++)
+		{
+			connected += m_agents[i].sock != INVALID_SOCKET && !m_agents[i].host.empty() ? 1 : 0;
+		}
+		return connected;
+	}
+
+	bool Busy() const { return m_recording || m_stopping; }
+
+private:
+	void Accept()
+	{
+		socket_t sock = accept(m_listener, NULL, NULL);
+		if (sock == INVALID_SOCKET)
+		{
+			return;
+		}
+		AgentConnection agent;
+		agent.sock = sock;
+		agent.started = false;
+		agent.stopped = true;
+		agent.frames = 0;
+		m_agents.push_back(agent);
+		m_hostNames.push_back("");
+		m_cameraNames.push_back(vector<string>());
+	}
+
+	void Receive(unsigned int index)
+	{
+		AgentConnection & agent = m_agents[index];
+		string line;
+		do
+		{
+			if (!ReadLine(agent.sock, agent.buffer, line))
+			{
+				cout << "Agent " << (agent.host.empty() ? "?" : agent.host) << " disconnected" << endl;
+				closesocket(agent.sock);
+				agent.sock = INVALID_SOCKET;
+				agent.stopped = true;
+				return;
+			}
+			HandleMessage(index, line);
+		} while (agent.buffer.find('\n') != string::npos);
+	}
+
+	void HandleMessage(unsigned int index, const string & line)
+	{
+		AgentConnection & agent = m_agents[index];
+		string type = JsonGetValue(line, "type");
+		if (type == "hello")
+		{
+			agent.host = JsonGetValue(line, "host");
+			string cameras = JsonGetValue(line, "cameras");
+			for (string::size_type pos = 0; pos < cameras.size();)
+			{
+				string::size_type comma = cameras.find(',', pos);
+				comma = comma == string::npos ? cameras.size() : comma;
+				agent.cameras.push_back(cameras.substr(pos, comma - pos));
+				pos = comma + 1;
+			}
+			m_hostNames[index] = agent.host;
+			m_cameraNames[index] = agent.cameras;
+			cout << "Agent " << agent.host << " connected with " << agent.cameras.size() << " cameras" << endl;
+		}
+		else if (type == "started")
+		{
+			agent.started = JsonGetValue(line, "ok") == "true";
+			if (!agent.started)
+			{
+				// The agent does not record and sends no stopped message
+				cout << "Agent " << agent.host << " failed to start: " << JsonGetValue(line, "error") << endl;
+				agent.stopped = true;
+			}
+		}
+		else if (type == "frames" && (m_recording || m_stopping))
+		{
+			// Frames of a host whose daemon is not recording are not indexed
+			if (!agent.started)
+			{
+				return;
+			}
+			m_batch.clear();
+			ParseSessionFrames(JsonGetValue(line, "frames"), m_batch);
+			for (size_t i = 0; i < m_batch.size(); i++)
+			{
+				// Cameras are few per host; a linear search is cheapest
+				vector<string>::const_iterator camera = find(agent.cameras.begin(), agent.cameras.end(), m_batch[i].serialNumber);
+				if (camera == agent.cameras.end())
+				{
+					continue;
+				}
+				m_index.Add(index, static_cast<unsigned int>(camera - agent.cameras.begin()), m_batch[i]);
+				agent.frames++;
+			}
+		}
+		else if (type == "stopped")
+		{
+			agent.stopped = true;
+			uint64_t skipped = strtoull(JsonGetValue(line, "skipped").c_str(), NULL, 10);
+			if (skipped > 0)
+			{
+				cout << "Agent " << agent.host << " missed " << skipped << " frames on its frame buses" << endl;
+			}
+			uint64_t untimed = strtoull(JsonGetValue(line, "untimed").c_str(), NULL, 10);
+			if (untimed > 0)
+			{
+				cout << "Agent " << agent.host << " left out " << untimed << " frames without a host timestamp" << endl;
+			}
+		}
+	}
+
+	bool AllStopped() const
+	{
+		for (size_t i = 0; i < m_agents.size(); i++)
+		{
+			if (!m_agents[i].stopped)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void FinishSession()
+	{
+		if (!AllStopped())
+		{
+			cout << "Not all agents confirmed the stop; the index may be incomplete..." << endl;
+		}
+		for (size_t i = 0; i < m_agents.size(); i++)
+		{
+			if (m_agents[i].sock != INVALID_SOCKET && !m_agents[i].started)
+			{
+				cout << "Agent " << m_agents[i].host << " did not record; its " << m_agents[i].cameras.size()
+					<< " cameras are missing from every set" << endl;
+			}
+		}
+		m_index.Write(m_sessionName + ".sets.csv", m_hostNames, m_cameraNames);
+		m_stopping = false;
+	}
+
+	void Broadcast(const string & message)
+	{
+		for (size_t i = 0; i < m_agents.size(); i++)
+		{
+			if (m_agents[i].sock != INVALID_SOCKET && !SendAll(m_agents[i].sock, message))
+			{
+				cout << "Agent " << m_agents[i].host << " is not reachable..." << endl;
+			}
+		}
+	}
+
+	socket_t m_listener;
+	vector<AgentConnection> m_agents;
+	vector<string> m_hostNames;
+	vector<vector<string> > m_cameraNames;
+
+	SetIndex m_index;
+	vector<SessionFrame> m_batch;
+	string m_sessionName;
+	bool m_recording;
+	bool m_stopping;
+	int64_t m_stopAt;
+};
+
+// Lines read from stdin, handed to the main loop. Windows cannot select() on
+// stdin, so a detached thread reads it; the reader is never destroyed, since
+// the thread may still be blocked in getline() at exit.
+class CommandReader
+{
+public:
+	CommandReader()
+	{
+		m_thread = thread(&CommandReader::Run, this);
+		m_thread.detach();
+	}
+
+	bool Next(string & command)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (m_commands.empty())
+		{
+			return false;
+		}
+		command = m_commands.front();
+		m_commands.pop_front();
+		return true;
+	}
+
+private:
+	void Run()
+	{
+		string line;
+		while (getline(cin, line))
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_commands.push_back(line);
+		}
+		lock_guard<mutex> lock(m_mutex);
+		m_commands.push_back("quit");
+	}
+
+	thread m_thread;
+	mutex m_mutex;
+	deque<string> m_commands;
+};
+
+// This function records one session on the given number of agents.
+int RecordSession(SessionCoordinator & coordinator, size_t agentCount, const string & name, double seconds)
+{
+	cout << "Waiting for " << agentCount << " agents..." << endl;
+	while (coordinator.ConnectedAgents() < agentCount)
+	{
+		coordinator.Poll(100);
+	}
+
+	if (coordinator.Start(name) != 0)
+	{
+		return -1;
+	}
+	chrono::steady_clock::time_point stopTime = chrono::steady_clock::now() + chrono::milliseconds(static_cast<int64_t>(seconds * 1000));
+	while (chrono::steady_clock::now() < stopTime)
+	{
+		coordinator.Poll(50);
+	}
+
+	coordinator.Stop();
+	while (coordinator.Busy())
+	{
+		coordinator.Poll(50);
+	}
+	coordinator.Shutdown();
+	return 0;
+}
+
+// This function serves the commands typed on stdin until "quit".
+int RunInteractive(SessionCoordinator & coordinator)
+{
+	cout << "Commands: start <name>, stop, status, quit" << endl;
+	CommandReader * reader = new CommandReader();
+	for (;;)
+	{
+		coordinator.Poll(50);
+
+		string line;
+		if (!reader->Next(line))
+		{
+			continue;
+		}
+		istringstream words(line);
+		string command;
+		string name;
+		words >> command >> name;
+		if (command == "start")
+		{
+			coordinator.Start(name.empty() ? "session" : name);
+		}
+		else if (command == "stop")
+		{
+			coordinator.Stop();
+		}
+		else if (command == "status")
+		{
+			coordinator.PrintStatus();
+		}
+		else if (command == "quit")
+		{
+			if (coordinator.Busy())
+			{
+				coordinator.Stop();
+				while (coordinator.Busy())
+				{
+					coordinator.Poll(50);
+				}
+			}
+			coordinator.Shutdown();
+			return 0;
+		}
+		else if (!command.empty())
+		{
+			cout << "Unknown command " << command << "..." << endl;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	string port = k_defaultCoordinatorPort;
+	double toleranceMs = k_defaultSetToleranceMs;
+	size_t agentCount = 0;
+	string sessionName;
+	double seconds = 0.0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--port" && i + 1 < argc)
+		{
+			port = argv[++i];
+		}
+		else if (arg == "--tolerance-ms" && i + 1 < argc)
+		{
+			toleranceMs = atof(argv[++i]);
+		}
+		else if (arg == "--agents" && i + 1 < argc)
+		{
+			agentCount = static_cast<size_t>(atoi(argv[++i]));
+		}
+		else if (arg == "--record" && i + 2 < argc)
+		{
+			sessionName = argv[++i];
+			seconds = atof(argv[++i]);
+		}
+		else
+		{
+			cout << "Usage: Coordinator [--port p] [--tolerance-ms t]" << endl;
+			cout << "       Coordinator [--port p] [--tolerance-ms t] --agents n --record name seconds" << endl;
+			return -1;
+		}
+	}
+
+	if (!InitSockets())
+	{
+		cout << "Unable to initialize sockets. Aborting..." << endl;
+		return -1;
+	}
+	socket_t listener = ListenTcpSocket(static_cast<unsigned short>(atoi(port.c_str())));
+	if (listener == INVALID_SOCKET)
+	{
+		cout << "Unable to listen on port " << port << ". Aborting..." << endl;
+		CleanupSockets();
+		return -1;
+	}
+	cout << "Coordinator listening on port " << port << ", set tolerance " << toleranceMs << " ms" << endl;
+
+	int result = 0;
+	{
+		SessionCoordinator coordinator(listener, toleranceMs);
+		if (!sessionName.empty())
+		{
+			result = RecordSession(coordinator, max<size_t>(agentCount, 1), sessionName, seconds);
+		}
+		else
+		{
+			result = RunInteractive(coordinator);
+		}
+	}
+
+	closesocket(listener);
+	CleanupSockets();
+	return result;
+}
@@ -0,0 +1,405 @@
+//=============================================================================
+// Export.cpp
+//
+// Offline exporter for the segmented recordings written by Trigger.cpp. It
+// converts the raw frames of one or more recordings into JPEG, PNG or BMP
+// sequences away from the capture machine:
+//
+//     Export [--format jpg|png|bmp] [--threads n] <outputDir> <segment.seg>...
+//
+// Frames are grouped into their synchronized sets and every set is exported
+// as a unit, named <outputDir>/<recording>-<set>-<serial>.<format>, so the
+// images of a set sort next to each other. The recording is the segment file
+// name without camera serial and segment number, e.g.
+// "run1-AcquisitionMultipleCamera"; set numbers restart with every run of
+// Trigger.cpp, so sets are told apart by recording and set number. Sets are
+// spread over a work-stealing pool of threads: every worker starts on its own
+// contiguous range of sets and steals from the far end of the other workers'
+// ranges once it runs dry. Every exported frame is appended to
+// <outputDir>/export.journal by format, camera, set and recording, and an
+// export started again skips the frames it lists, so an interrupted export
+// resumes, and one run again with more recordings exports only the new
+// frames.
+//
+// Video is not encoded here; the numbered images of a camera can be handed
+// to an encoder, for example:
+//
+//     ffmpeg -pattern_type glob -i 'out/run1-*-<serial>.jpg' -c:v libx264 <serial>.mp4
+//=============================================================================
+
+#include "RecordingReader.h"
+#include "Spinnaker.h"
+#include "SpinGenApi/SpinnakerGenApi.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+using namespace Spinnaker;
+using namespace Spinnaker::GenApi;
+using namespace Spinnaker::GenICam;
+using namespace std;
+
+// A frame of a synchronized set, with the camera it came from.
+struct ExportFrame
+{
+	SegmentFrame frame;
+	string serialNumber;
+};
+
+struct ExportSet
+{
+	string recording;
+	uint64_t setSequence;
+	vector<ExportFrame> frames;
+};
+
+// An exported frame in the journal: recording, camera serial and set.
+typedef tuple<string, string, uint64_t> JournalKey;
+
+// Sets still to be exported by one worker. The owner takes sets from the
+// front, thieves from the back, so they only meet on the last set.
+struct WorkQueue
+{
+	mutex lock;
+	deque<size_t> sets;
+};
+
+// This class holds the state shared by the export workers.
+class ExportJob
+{
+public:
+	ExportJob(const string & outputDir, const string & format, vector<ExportSet> & sets, unsigned int numWorkers)
+		: m_outputDir(outputDir), m_format(format), m_sets(sets), m_queues(numWorkers), m_journal(NULL),
+		m_exportedFrames(0), m_failedFrames(0), m_stolenSets(0) {}
+
+	~ExportJob()
+	{
+		if (m_journal != NULL)
+		{
+			fclose(m_journal);
+		}
+	}
+
+	// Reads the frames exported by earlier runs and opens the journal for
+	// appending. Returns the number of sets skipped.
+	size_t OpenJournal()
+	{
+		string path = m_outputDir + "/export.journal";
+		FILE * journal = fopen(path.c_str(), "r");
+		if (journal != NULL)
+		{
+			// The recording ends the line, so it may hold spaces
+			char line[1024];
+			while (fgets(line, sizeof(line), journal) != NULL)
+			{
+				char format[16];
+				char serialNumber[64];
+				unsigned long long setSequence = 0;
+				int recordingStart = 0;
+				if (sscanf(line, "%15s %63s %llu %n", format, serialNumber, &setSequence, &recordingStart) == 3 && m_format == format)
+				{
+					string recording(line + recordingStart);
+					recording.erase(recording.find_last_not_of("\r\n") + 1);
+					m_done.insert(JournalKey(recording, serialNumber, static_cast<uint64_t>(setSequence)));
+				}
+			}
+			fclose(journal);
+		}
+
+		// Deal the sets with frames left to export out in contiguous ranges
+		vector<size_t> pending;
+		for (size_t i = 0; i < m_sets.size(); i++)
+		{
+			for (size_t j = 0; j < m_sets[i].frames.size(); j++)
+			{
+				if (!IsDone(m_sets[i], m_sets[i].frames[j]))
+				{
+					pending.push_back(i);
+					break;
+				}
+			}
+		}
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			m_queues[i * m_queues.size() / pending.size()].sets.push_back(pending[i]);
+		}
+
+		m_journal = fopen(path.c_str(), "a");
+		return m_sets.size() - pending.size();
+	}
+
+	void RunWorker(unsigned int worker)
+	{
+		size_t setIndex = 0;
+		while (TakeSet(worker, setIndex))
+		{
+			ExportSetImages(m_sets[setIndex]);
+		}
+	}
+
+	uint64_t ExportedFrames() const { return m_exportedFrames.load(); }
+	uint64_t FailedFrames() const { return m_failedFrames.load(); }
+	uint64_t StolenSets() const { return m_stolenSets.load(); }
+
+private:
+	bool TakeSet(unsigned int worker, size_t & setIndex)
+	{
+		{
+			WorkQueue & own = m_queues[worker];
+			lock_guard<mutex> lock(own.lock);
+			if (!own.sets.empty())
+			{
+				setIndex = own.sets.front();
+				own.sets.pop_front();
+				return true;
+			}
+		}
+
+		// Steal from the other workers, nearest neighbour first. No work is
+		// added after the start, so empty queues everywhere means done.
+		for (size_t n = 1; n < m_queues.size(); n++)
+		{
+			WorkQueue & victim = m_queues[(worker + n) % m_queues.size()];
+			lock_guard<mutex> lock(victim.lock);
+			if (!victim.sets.empty())
+			{
+				setIndex = victim.sets.back();
+				victim.sets.pop_back();
+				m_stolenSets++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Returns true if an earlier run exported the frame. The set of done
+	// frames is filled before the workers start and only read after.
+	bool IsDone(const ExportSet & exportSet, const ExportFrame & exportFrame) const
+	{
+		return m_done.find(JournalKey(exportSet.recording, exportFrame.serialNumber, exportSet.setSequence)) != m_done.end();
+	}
+
+	void Journal(const ExportSet & exportSet, const ExportFrame & exportFrame)
+	{
+		lock_guard<mutex> lock(m_journalMutex);
+		if (m_journal != NULL)
+		{
+			fprintf(m_journal, "%s %s %llu %s\n", m_format.c_str(), exportFrame.serialNumber.c_str(),
+				static_cast<unsigned long long>(exportSet.setSequence), exportSet.recording.c_str());
+			fflush(m_journal);
+		}
+	}
+
+	// Converts and saves the frames of a set not exported yet. Frames that
+	// fail are not journaled and are retried by the next run.
+	void ExportSetImages(const ExportSet & exportSet)
+	{
+		for (size_t i = 0; i < exportSet.frames.size(); i++)
+		{
+			const ExportFrame & exportFrame = exportSet.frames[i];
+			const SegmentFrameHeader & header = *exportFrame.frame.header;
+			if (IsDone(exportSet, exportFrame))
+			{
+				continue;
+			}
+
+			ostringstream filename;
+			filename << m_outputDir << "/" << exportSet.recording << "-";
+			filename.width(10);
+			filename.fill('0');
+			filename << exportSet.setSequence;
+			filename << "-" << exportFrame.serialNumber << "." << m_format;
+
+			try
+			{
+				ImagePtr pImage = Image::Create(header.width, header.height, 0, 0, static_cast<PixelFormatEnums>(header.pixelFormat), exportFrame.frame.data);
+
+				// Mono formats are reduced to 8 bits, everything else is
+				// debayered or converted to 8-bit color
+				string pixelFormatName = pImage->GetPixelFormatName().c_str();
+				ImagePtr convertedImage = pixelFormatName.compare(0, 4, "Mono") == 0
+					? pImage->Convert(PixelFormat_Mono8, HQ_LINEAR)
+					: pImage->Convert(PixelFormat_BGR8, HQ_LINEAR);
+
+				convertedImage->Save(filename.str().c_str());
+				m_exportedFrames++;
+				Journal(exportSet, exportFrame);
+			}
+			catch (Spinnaker::Exception &e)
+			{
+				cout << "Error exporting " << filename.str() << ": " << e.what() << endl;
+				m_failedFrames++;
+			}
+		}
+	}
+
+	string m_outputDir;
+	string m_format;
+	vector<ExportSet> & m_sets;
+	vector<WorkQueue> m_queues;
+
+	set<JournalKey> m_done;
+	mutex m_journalMutex;
+	FILE * m_journal;
+
+	atomic<uint64_t> m_exportedFrames;
+	atomic<uint64_t> m_failedFrames;
+	atomic<uint64_t> m_stolenSets;
+};
+
+// This function returns the recording a segment belongs to: the file name
+// without directory, camera serial and segment number.
+string RecordingNameOf(const string & segmentPath, const string & serialNumber)
+{
+	string::size_type slash = segmentPath.find_last_of("/\\");
+	string name = slash == string::npos ? segmentPath : segmentPath.substr(slash + 1);
+	string::size_type dash = name.rfind('-');
+	if (dash != string::npos)
+	{
+		name.erase(dash);
+	}
+	string serialSuffix = "-" + serialNumber;
+	if (name.size() > serialSuffix.size() && name.compare(name.size() - serialSuffix.size(), serialSuffix.size(), serialSuffix) == 0)
+	{
+		name.erase(name.size() - serialSuffix.size());
+	}
+	return name;
+}
+
+// This function maps the given segments and groups their frames by
+// recording and synchronized set, in set order.
+int LoadSets(const vector<string> & segmentPaths, vector<unique_ptr<SegmentReader> > & readers, vector<ExportSet> & sets)
+{
+	map<pair<string, uint64_t>, ExportSet> setMap;
+
+	for (size_t i = 0; i < segmentPaths.size(); i++)
+	{
+		unique_ptr<SegmentReader> reader(new SegmentReader());
+		if (!reader->Open(segmentPaths[i]))
+		{
+			cout << "Failed to open segment " << segmentPaths[i] << ". Aborting..." << endl;
+			return -1;
+		}
+
+		char serialNumber[sizeof(reader->Header().serialNumber) + 1];
+		memcpy(serialNumber, reader->Header().serialNumber, sizeof(reader->Header().serialNumber));
+		serialNumber[sizeof(serialNumber) - 1] = '\0';
+
+		string recording = RecordingNameOf(segmentPaths[i], serialNumber);
+		const vector<SegmentFrame> & frames = reader->Frames();
+		cout << segmentPaths[i] << ": " << frames.size() << " frames" << (reader->Indexed() ? "" : " (not finalized)") << endl;
+		for (size_t j = 0; j < frames.size(); j++)
+		{
+			ExportFrame exportFrame;
+			exportFrame.frame = frames[j];
+			exportFrame.serialNumber = serialNumber;
+
+			ExportSet & exportSet = setMap[make_pair(recording, frames[j].header->setSequence)];
+			exportSet.recording = recording;
+			exportSet.setSequence = frames[j].header->setSequence;
+			exportSet.frames.push_back(exportFrame);
+		}
+		readers.push_back(move(reader));
+	}
+
+	for (map<pair<string, uint64_t>, ExportSet>::iterator it = setMap.begin(); it != setMap.end(); ++it)
+	{
+		sets.push_back(it->second);
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	string format = "jpg";
+	unsigned int numThreads = thread::hardware_concurrency();
+	vector<string> positional;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--format" && i + 1 < argc)
+		{
+			format = argv[++i];
+		}
+		else if (arg == "--threads" && i + 1 < argc)
+		{
+			numThreads = static_cast<unsigned int>(atoi(argv[++i]));
+		}
+		else
+		{
+			positional.push_back(arg);
+		}
+	}
+
+	if (positional.size() < 2 || (format != "jpg" && format != "png" && format != "bmp"))
+	{
+		cout << "Usage: Export [--format jpg|png|bmp] [--threads n] <outputDir> <segment.seg>..." << endl;
+		return -1;
+	}
+	if (numThreads == 0)
+	{
+		numThreads = 1;
+	}
+
+	string outputDir = positional[0];
+	vector<string> segmentPaths(positional.begin() + 1, positional.end());
+
+#ifdef _WIN32
+	_mkdir(outputDir.c_str());
+#else
+	mkdir(outputDir.c_str(), 0755);
+#endif
+
+	vector<unique_ptr<SegmentReader> > readers;
+	vector<ExportSet> sets;
+	if (LoadSets(segmentPaths, readers, sets) != 0)
+	{
+		return -1;
+	}
+
+	ExportJob job(outputDir, format, sets, numThreads);
+	size_t skipped = job.OpenJournal();
+	cout << endl << "Exporting " << sets.size() - skipped << " of " << sets.size() << " sets to " << outputDir << " on " << numThreads << " threads..." << endl;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	vector<thread> workers;
+	for (unsigned int i = 0; i < numThreads; i++)
+	{
+		workers.push_back(thread(&ExportJob::RunWorker, &job, i));
+	}
+	for (unsigned int i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << "Exported " << job.ExportedFrames() << " frames in " << seconds << " s (" << (seconds > 0.0 ? job.ExportedFrames() / seconds : 0.0)
+		<< " frames/s), " << job.StolenSets() << " sets stolen" << endl;
+
+	if (job.FailedFrames() > 0)
+	{
+		cout << job.FailedFrames() << " frames failed; run again to retry them..." << endl;
+		return -1;
+	}
+	return 0;
+}
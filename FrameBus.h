@@ -0,0 +1,498 @@
+//=============================================================================
+// FrameBus.h
+//
+// Shared-memory ring that publishes the live frames of one camera to other
+// processes. Trigger.cpp is the single producer; any number of consumers map
+// the ring and read frames in place, without copies or sockets. Consumers
+// only write to their entry in the reader table, never to the slots.
+//
+// The ring is a FrameBusHeader followed by slotCount slots, each a
+// FrameBusSlot header followed by slotDataSize bytes of raw image data.
+// Frames are numbered from 1. Every slot is guarded by a sequence lock: while
+// frame n is written its slot sequence is 2n-1, once published it is 2n. A
+// consumer checks the slot sequence before and after reading; if it changed,
+// the producer lapped the consumer and the frame is skipped. The producer
+// never waits for consumers.
+//
+// Consumers may register in the reader table and report their position; the
+// producer then counts how often each reader falls a full ring behind.
+//
+// A ring has one producer. Creating a ring whose name is taken by a running
+// producer fails; a ring left behind by a producer that died is replaced. A
+// producer that closes its ring clears the magic, which tells consumers still
+// mapping it to open the ring again.
+//=============================================================================
+
+#ifndef FRAME_BUS_H
+#define FRAME_BUS_H
+
+#include "FrameMetadata.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cstring>
+#include <string>
+
+// "CSFB" in file order
+const uint32_t k_frameBusMagic = 0x42465343;
+const uint32_t k_frameBusVersion = 2;
+const unsigned int k_frameBusMaxReaders = 8;
+
+struct FrameBusReaderEntry
+{
+	std::atomic<uint32_t> active;		// 1 while a reader holds the entry
+	std::atomic<uint32_t> lapped;		// times the producer lapped the reader
+	std::atomic<uint64_t> position;		// last frame consumed by the reader
+};
+
+struct FrameBusHeader
+{
+	uint32_t magic;						// k_frameBusMagic
+	uint32_t version;					// k_frameBusVersion
+	uint32_t slotCount;
+	uint32_t slotDataSize;				// payload capacity of a slot in bytes
+	uint64_t slotStride;				// distance between slots in bytes
+	char serialNumber[16];				// device serial number, zero padded
+	uint64_t ownerPid;					// process id of the producer
+	std::atomic<uint64_t> published;	// last published frame, 0 if none
+	FrameBusReaderEntry readers[k_frameBusMaxReaders];
+};
+
+struct FrameBusSlot
+{
+	std::atomic<uint64_t> sequence;		// 2n-1 while frame n is written, 2n once published
+	uint64_t setSequence;				// synchronized set the frame belongs to
+	uint32_t width;
+	uint32_t height;
+	uint32_t pixelFormat;				// Spinnaker PixelFormatEnums value
+	uint32_t dataSize;					// bytes of image data in the slot
+	FrameMetadataRecord metadata;
+};
+
+// Name of the ring of a camera, for shm_open() or CreateFileMapping().
+inline std::string FrameBusName(const std::string & serialNumber)
+{
+#ifdef _WIN32
+	return "Local\\camerasync-" + serialNumber;
+#else
+	return "/camerasync-" + serialNumber;
+#endif
+}
+
+inline uint64_t FrameBusSlotStride(uint32_t slotDataSize)
+{
+	// Keep slots and their data cache line aligned
+	return (sizeof(FrameBusSlot) + slotDataSize + 63) & ~static_cast<uint64_t>(63);
+}
+
+inline uint64_t FrameBusHeaderSize()
+{
+	return (sizeof(FrameBusHeader) + 63) & ~static_cast<uint64_t>(63);
+}
+
+inline uint64_t CurrentProcessId()
+{
+#ifdef _WIN32
+	return GetCurrentProcessId();
+#else
+	return static_cast<uint64_t>(getpid());
+#endif
+}
+
+inline bool ProcessAlive(uint64_t pid)
+{
+#ifdef _WIN32
+	HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(pid));
+	if (process == NULL)
+	{
+		return GetLastError() == ERROR_ACCESS_DENIED;
+	}
+	bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+	CloseHandle(process);
+	return alive;
+#else
+	return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#endif
+}
+
+#ifndef _WIN32
+// Returns true if a ring left at the name still has a running producer.
+// Removes the name if the producer is gone.
+inline bool FrameBusInUse(const std::string & name)
+{
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+	{
+		return false;
+	}
+	FrameBusHeader header;
+	bool inUse = pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) && header.magic == k_frameBusMagic
+		&& header.version == k_frameBusVersion && ProcessAlive(header.ownerPid);
+	close(fd);
+	if (!inUse)
+	{
+		shm_unlink(name.c_str());
+	}
+	return inUse;
+}
+#endif
+
+// Maps a named shared memory object of the given size. A new object is
+// created exclusively: creating fails if the name is already in use. Returns
+// NULL on failure.
+inline void * MapFrameBus(const std::string & name, uint64_t size, bool create, void ** handle)
+{
+#ifdef _WIN32
+	HANDLE mapping = create
+		? CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), name.c_str())
+		: OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+	if (mapping == NULL)
+	{
+		return NULL;
+	}
+	if (create && GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		// Another producer, or consumers of a closed ring, still hold it
+		CloseHandle(mapping);
+		return NULL;
+	}
+	void * view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, create ? static_cast<SIZE_T>(size) : 0);
+	if (view == NULL)
+	{
+		CloseHandle(mapping);
+		return NULL;
+	}
+	*handle = mapping;
+	return view;
+#else
+	*handle = NULL;
+	int fd = create ? shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644) : shm_open(name.c_str(), O_RDWR, 0);
+	if (fd < 0 && create && errno == EEXIST && !FrameBusInUse(name))
+	{
+		fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	}
+	if (fd < 0)
+	{
+		return NULL;
+	}
+	if (create && ftruncate(fd, static_cast<off_t>(size)) != 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	void * view = mmap(NULL, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	return view == MAP_FAILED ? NULL : view;
+#endif
+}
+
+inline void UnmapFrameBus(void * view, uint64_t size, void * handle)
+{
+#ifdef _WIN32
+	(void)size;
+	UnmapViewOfFile(view);
+	CloseHandle(static_cast<HANDLE>(handle));
+#else
+	(void)handle;
+	munmap(view, static_cast<size_t>(size));
+#endif
+}
+
+// Producer side, used by the acquisition loop.
+class FrameBusWriter
+{
+public:
+	FrameBusWriter() : m_header(NULL), m_size(0), m_handle(NULL), m_lappedReaders(0) {}
+	~FrameBusWriter() { Close(); }
+
+	// Creates the ring. Fails if another producer is running on the name.
+	bool Create(const std::string & name, uint32_t slotCount, uint32_t slotDataSize, const std::string & serialNumber)
+	{
+		Close();
+		m_name = name;
+		m_size = FrameBusHeaderSize() + slotCount * FrameBusSlotStride(slotDataSize);
+		void * view = MapFrameBus(name, m_size, true, &m_handle);
+		if (view == NULL)
+		{
+			return false;
+		}
+
+		// A new object is zero filled; the slot sequences are set below
+		memset(view, 0, static_cast<size_t>(FrameBusHeaderSize()));
+		m_header = static_cast<FrameBusHeader *>(view);
+		m_header->ownerPid = CurrentProcessId();
+		m_header->slotCount = slotCount;
+		m_header->slotDataSize = slotDataSize;
+		m_header->slotStride = FrameBusSlotStride(slotDataSize);
+		strncpy(m_header->serialNumber, serialNumber.c_str(), sizeof(m_header->serialNumber));
+		for (uint32_t i = 0; i < slotCount; i++)
+		{
+			Slot(i)->sequence.store(0);
+		}
+		m_header->published.store(0);
+		m_header->version = k_frameBusVersion;
+
+		// The magic is written last; consumers ignore the ring until then
+		std::atomic_thread_fence(std::memory_order_release);
+		m_header->magic = k_frameBusMagic;
+		return true;
+	}
+
+	void Close()
+	{
+		if (m_header == NULL)
+		{
+			return;
+		}
+		m_header->magic = 0;
+		UnmapFrameBus(m_header, m_size, m_handle);
+#ifndef _WIN32
+		shm_unlink(m_name.c_str());
+#endif
+		m_header = NULL;
+	}
+
+	bool IsOpen() const
+	{
+		return m_header != NULL;
+	}
+
+	// Copies a frame into the next slot and publishes it. Frames larger than a
+	// slot are truncated to the slot size.
+	void Publish(const FrameMetadataRecord & metadata, uint64_t setSequence, uint32_t width, uint32_t height, uint32_t pixelFormat,
+		const void * data, size_t dataSize)
+	{
+		if (m_header == NULL)
+		{
+			return;
+		}
+
+		uint64_t frame = m_header->published.load(std::memory_order_relaxed) + 1;
+		FrameBusSlot * slot = Slot(static_cast<uint32_t>(frame % m_header->slotCount));
+
+		slot->sequence.store(2 * frame - 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		size_t copySize = dataSize < m_header->slotDataSize ? dataSize : m_header->slotDataSize;
+		slot->setSequence = setSequence;
+		slot->width = width;
+		slot->height = height;
+		slot->pixelFormat = pixelFormat;
+		slot->dataSize = static_cast<uint32_t>(copySize);
+		slot->metadata = metadata;
+		memcpy(reinterpret_cast<char *>(slot) + sizeof(FrameBusSlot), data, copySize);
+
+		slot->sequence.store(2 * frame, std::memory_order_release);
+		m_header->published.store(frame, std::memory_order_release);
+
+		// Flag registered readers that just fell a full ring behind
+		for (unsigned int i = 0; i < k_frameBusMaxReaders; i++)
+		{
+			FrameBusReaderEntry & reader = m_header->readers[i];
+			if (reader.active.load(std::memory_order_relaxed) != 0
+				&& frame - reader.position.load(std::memory_order_relaxed) == m_header->slotCount + 1)
+			{
+				reader.lapped.fetch_add(1, std::memory_order_relaxed);
+				m_lappedReaders++;
+			}
+		}
+	}
+
+	// Number of times any registered reader was lapped.
+	unsigned int LappedReaders() const
+	{
+		return m_lappedReaders;
+	}
+
+private:
+	FrameBusSlot * Slot(uint32_t index) const
+	{
+		return reinterpret_cast<FrameBusSlot *>(reinterpret_cast<char *>(m_header) + FrameBusHeaderSize() + index * m_header->slotStride);
+	}
+
+	std::string m_name;
+	FrameBusHeader * m_header;
+	uint64_t m_size;
+	void * m_handle;
+	unsigned int m_lappedReaders;
+};
+
+// Consumer side, for analysis tools in other processes. A typical loop:
+//
+//   FrameBusReader reader;
+//   reader.Open(FrameBusName("16276718"));
+//   uint64_t next = reader.Published() + 1;
+//   for (;;)
+//   {
+//       const FrameBusSlot * slot = reader.Acquire(next);  // NULL if not yet published
+//       ... process reader.Data(slot) in place ...
+//       if (!reader.Release(slot, next)) { ... frame was overwritten, discard ... }
+//       next = reader.Next(next);
+//   }
+//
+class FrameBusReader
+{
+public:
+	FrameBusReader() : m_header(NULL), m_size(0), m_handle(NULL), m_entry(NULL), m_skipped(0) {}
+	~FrameBusReader() { Close(); }
+
+	bool Open(const std::string & name)
+	{
+		Close();
+
+		// Map the header first to learn the size of the ring
+		void * handle = NULL;
+		void * view = MapFrameBus(name, FrameBusHeaderSize(), false, &handle);
+		if (view == NULL)
+		{
+			return false;
+		}
+		FrameBusHeader * header = static_cast<FrameBusHeader *>(view);
+		bool valid = header->magic == k_frameBusMagic && header->version == k_frameBusVersion;
+		uint64_t size = FrameBusHeaderSize() + header->slotCount * header->slotStride;
+		UnmapFrameBus(view, FrameBusHeaderSize(), handle);
+		if (!valid)
+		{
+			return false;
+		}
+
+		view = MapFrameBus(name, size, false, &m_handle);
+		if (view == NULL)
+		{
+			return false;
+		}
+		m_header = static_cast<FrameBusHeader *>(view);
+		m_size = size;
+
+		// Register for slow reader detection if an entry is free
+		for (unsigned int i = 0; i < k_frameBusMaxReaders && m_entry == NULL; i++)
+		{
+			uint32_t expected = 0;
+			if (m_header->readers[i].active.compare_exchange_strong(expected, 1))
+			{
+				m_entry = &m_header->readers[i];
+				m_entry->lapped.store(0);
+				m_entry->position.store(m_header->published.load());
+			}
+		}
+		return true;
+	}
+
+	void Close()
+	{
+		if (m_header == NULL)
+		{
+			return;
+		}
+		if (m_entry != NULL)
+		{
+			m_entry->active.store(0);
+			m_entry = NULL;
+		}
+		UnmapFrameBus(m_header, m_size, m_handle);
+		m_header = NULL;
+	}
+
+	const FrameBusHeader * Header() const
+	{
+		return m_header;
+	}
+
+	// Returns false once the producer has left the ring: it cleared the magic
+	// when it closed the ring, or its process is gone. The ring then has to be
+	// opened again by name. Checking the producer takes a system call, so
+	// callers do that only while no frames arrive.
+	bool Live(bool checkProducer) const
+	{
+		if (*static_cast<const volatile uint32_t *>(&m_header->magic) != k_frameBusMagic)
+		{
+			return false;
+		}
+		return !checkProducer || ProcessAlive(m_header->ownerPid);
+	}
+
+	uint64_t Published() const
+	{
+		return m_header->published.load(std::memory_order_acquire);
+	}
+
+	// Returns the slot holding a frame, or NULL if the frame is not published
+	// yet or already overwritten.
+	const FrameBusSlot * Acquire(uint64_t frame) const
+	{
+		const FrameBusSlot * slot = Slot(static_cast<uint32_t>(frame % m_header->slotCount));
+		if (slot->sequence.load(std::memory_order_acquire) != 2 * frame)
+		{
+			return NULL;
+		}
+		return slot;
+	}
+
+	static const unsigned char * Data(const FrameBusSlot * slot)
+	{
+		return reinterpret_cast<const unsigned char *>(slot) + sizeof(FrameBusSlot);
+	}
+
+	// Returns true if the frame stayed intact while it was being read.
+	bool Release(const FrameBusSlot * slot, uint64_t frame)
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		bool intact = slot->sequence.load(std::memory_order_relaxed) == 2 * frame;
+		if (m_entry != NULL)
+		{
+			m_entry->position.store(frame, std::memory_order_relaxed);
+		}
+		if (!intact)
+		{
+			m_skipped++;
+		}
+		return intact;
+	}
+
+	// Returns the next frame to read after the given one, jumping ahead if
+	// the producer has already overwritten it.
+	uint64_t Next(uint64_t frame)
+	{
+		uint64_t published = Published();
+		uint64_t oldest = published >= m_header->slotCount ? published - m_header->slotCount + 1 : 1;
+		if (frame + 1 < oldest)
+		{
+			m_skipped += oldest - frame - 1;
+			if (m_entry != NULL)
+			{
+				m_entry->position.store(oldest - 1, std::memory_order_relaxed);
+			}
+			return oldest;
+		}
+		return frame + 1;
+	}
+
+	// Frames this reader missed because it was too slow.
+	uint64_t Skipped() const
+	{
+		return m_skipped;
+	}
+
+private:
+	const FrameBusSlot * Slot(uint32_t index) const
+	{
+		return reinterpret_cast<const FrameBusSlot *>(reinterpret_cast<const char *>(m_header) + FrameBusHeaderSize() + index * m_header->slotStride);
+	}
+
+	FrameBusHeader * m_header;
+	uint64_t m_size;
+	void * m_handle;
+	FrameBusReaderEntry * m_entry;
+	uint64_t m_skipped;
+};
+
+#endif // FRAME_BUS_H
@@ -0,0 +1,44 @@
+//=============================================================================
+// FrameMetadata.h
+//
+// On-disk layout of the per-frame metadata stream written next to the images
+// of each camera. The stream is a FrameMetadataHeader followed by one
+// FrameMetadataRecord per grabbed frame, all little-endian and tightly
+// packed so that analysis tools can map the file and index it directly.
+//=============================================================================
+
+#ifndef FRAME_METADATA_H
+#define FRAME_METADATA_H
+
+#include <stdint.h>
+
+// "CSMD" in file order
+const uint32_t k_frameMetadataMagic = 0x444D5343;
+const uint32_t k_frameMetadataVersion = 2;
+
+#pragma pack(push, 1)
+
+struct FrameMetadataHeader
+{
+	uint32_t magic;			// k_frameMetadataMagic
+	uint32_t version;		// k_frameMetadataVersion
+	uint32_t recordSize;	// sizeof(FrameMetadataRecord)
+	uint32_t cameraIndex;	// index of the camera in the camera list
+	char serialNumber[16];	// device serial number, zero padded
+};
+
+struct FrameMetadataRecord
+{
+	uint64_t frameId;		// ChunkFrameID
+	uint64_t timestamp;		// ChunkTimestamp, camera clock in ns
+	double exposureTime;	// ChunkExposureTime in us
+	double gain;			// ChunkGain in dB
+	uint32_t lineStatusAll;	// ChunkExposureEndLineStatusAll, one bit per line
+	uint32_t imageCnt;		// acquisition loop counter (matches the filename)
+	int64_t hostTimestamp;	// timestamp mapped to host wall-clock ns since the
+							// epoch, 0 before the camera clock is synchronized
+};
+
+#pragma pack(pop)
+
+#endif // FRAME_METADATA_H
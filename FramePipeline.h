@@ -0,0 +1,240 @@
+//=============================================================================
+// FramePipeline.h
+//
+// Per-frame processing chain of Trigger.cpp, specialized at compile time on
+// the source pixel format. Every frame is first reduced to an 8-bit plane
+// (LumaPlane) that feeds the brightness statistics and the motion gate:
+//
+//     Mono8        the frame itself, no copy
+//     Mono12p      unpacked, top 8 bits of every pixel
+//     BayerRG8     2x2 binned, one pixel per Bayer quad (R + G + G + B) / 4
+//     BayerRG12p   unpacked and 2x2 binned
+//
+// FramePipeline<Bayer, Bits> holds the loops for one combination; bit depth
+// and binning are template parameters, so the inner loops carry no per-pixel
+// branches and can be vectorized by the compiler. CreateFramePipeline()
+// selects the specialization once per session from the camera's PixelFormat;
+// any other format falls back to a generic pipeline built on Convert().
+//=============================================================================
+
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include "Spinnaker.h"
+
+#include <stdint.h>
+#include <vector>
+
+// An 8-bit image plane, valid until the pipeline processes the next frame.
+struct LumaPlane
+{
+	const uint8_t * data;
+	unsigned int width;
+	unsigned int height;
+	size_t stride;
+};
+
+class FrameProcessor
+{
+public:
+	virtual ~FrameProcessor() {}
+
+	// Source pixel format the pipeline was built for.
+	virtual Spinnaker::PixelFormatEnums Format() const = 0;
+
+	// Reduces a frame to its 8-bit plane.
+	virtual const LumaPlane & Process(const Spinnaker::ImagePtr & pImage) = 0;
+
+	// Returns the frame as an image an encoder can take, i.e. Mono8.
+	virtual Spinnaker::ImagePtr PrepareForEncode(const Spinnaker::ImagePtr & pImage) = 0;
+};
+
+// Row readers: return a row of samples, unpacking it into buffer if the
+// format is packed. GenICam 12p packs two pixels into three bytes, least
+// significant bits first.
+template <unsigned int Bits>
+struct RowReader;
+
+template <>
+struct RowReader<8>
+{
+	typedef uint8_t Sample;
+
+	static const Sample * Read(const uint8_t * row, unsigned int /*width*/, std::vector<uint16_t> & /*buffer*/)
+	{
+		return row;
+	}
+};
+
+template <>
+struct RowReader<12>
+{
+	typedef uint16_t Sample;
+
+	static const Sample * Read(const uint8_t * row, unsigned int width, std::vector<uint16_t> & buffer)
+	{
+		uint16_t * samples = &buffer[0];
+		for (unsigned int x = 0; x < width / 2; x++)
+		{
+			const uint8_t * bytes = row + 3 * x;
+			samples[2 * x] = static_cast<uint16_t>(bytes[0] | ((bytes[1] & 0x0F) << 8));
+			samples[2 * x + 1] = static_cast<uint16_t>((bytes[1] >> 4) | (bytes[2] << 4));
+		}
+		if (width & 1)
+		{
+			const uint8_t * bytes = row + 3 * (width / 2);
+			samples[width - 1] = static_cast<uint16_t>(bytes[0] | ((bytes[1] & 0x0F) << 8));
+		}
+		return samples;
+	}
+};
+
+template <bool Bayer, unsigned int Bits>
+class FramePipeline : public FrameProcessor
+{
+public:
+	explicit FramePipeline(Spinnaker::PixelFormatEnums format) : m_format(format) {}
+
+	Spinnaker::PixelFormatEnums Format() const
+	{
+		return m_format;
+	}
+
+	const LumaPlane & Process(const Spinnaker::ImagePtr & pImage)
+	{
+		const uint8_t * data = static_cast<const uint8_t *>(pImage->GetData());
+		unsigned int width = static_cast<unsigned int>(pImage->GetWidth());
+		unsigned int height = static_cast<unsigned int>(pImage->GetHeight());
+		size_t stride = pImage->GetStride();
+
+		// Mono8 is its own plane
+		if (!Bayer && Bits == 8)
+		{
+			m_plane.data = data;
+			m_plane.width = width;
+			m_plane.height = height;
+			m_plane.stride = stride;
+			return m_plane;
+		}
+
+		m_plane.width = Bayer ? width / 2 : width;
+		m_plane.height = Bayer ? height / 2 : height;
+		m_plane.stride = m_plane.width;
+		m_luma.resize(m_plane.stride * m_plane.height);
+		m_rows[0].resize(width);
+		m_rows[1].resize(width);
+		m_plane.data = m_luma.empty() ? NULL : &m_luma[0];
+
+		for (unsigned int y = 0; y < m_plane.height; y++)
+		{
+			uint8_t * out = &m_luma[y * m_plane.stride];
+			if (Bayer)
+			{
+				const typename RowReader<Bits>::Sample * even = RowReader<Bits>::Read(data + (2 * y) * stride, width, m_rows[0]);
+				const typename RowReader<Bits>::Sample * odd = RowReader<Bits>::Read(data + (2 * y + 1) * stride, width, m_rows[1]);
+				BinRow(even, odd, out, m_plane.width);
+			}
+			else
+			{
+				const typename RowReader<Bits>::Sample * row = RowReader<Bits>::Read(data + y * stride, width, m_rows[0]);
+				ShiftRow(row, out, m_plane.width);
+			}
+		}
+		return m_plane;
+	}
+
+	Spinnaker::ImagePtr PrepareForEncode(const Spinnaker::ImagePtr & pImage)
+	{
+		if (Bayer)
+		{
+			// Full resolution needs a real debayer
+			return pImage->Convert(Spinnaker::PixelFormat_Mono8, Spinnaker::HQ_LINEAR);
+		}
+		if (Bits == 8)
+		{
+			return pImage;
+		}
+		const LumaPlane & plane = Process(pImage);
+		return Spinnaker::Image::Create(plane.width, plane.height, 0, 0, Spinnaker::PixelFormat_Mono8, const_cast<uint8_t *>(plane.data));
+	}
+
+private:
+	template <typename Sample>
+	static void ShiftRow(const Sample * row, uint8_t * out, unsigned int width)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			out[x] = static_cast<uint8_t>(row[x] >> (Bits - 8));
+		}
+	}
+
+	// Sums each 2x2 quad; the sum of a Bayer quad does not depend on the
+	// pattern, so any Bayer order works.
+	template <typename Sample>
+	static void BinRow(const Sample * even, const Sample * odd, uint8_t * out, unsigned int width)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			unsigned int sum = even[2 * x] + even[2 * x + 1] + odd[2 * x] + odd[2 * x + 1];
+			out[x] = static_cast<uint8_t>(sum >> (Bits - 8 + 2));
+		}
+	}
+
+	Spinnaker::PixelFormatEnums m_format;
+	LumaPlane m_plane;
+	std::vector<uint8_t> m_luma;
+	std::vector<uint16_t> m_rows[2];
+};
+
+// Fallback for formats without a specialization: converts every frame with
+// Spinnaker.
+class GenericFramePipeline : public FrameProcessor
+{
+public:
+	explicit GenericFramePipeline(Spinnaker::PixelFormatEnums format) : m_format(format) {}
+
+	Spinnaker::PixelFormatEnums Format() const
+	{
+		return m_format;
+	}
+
+	const LumaPlane & Process(const Spinnaker::ImagePtr & pImage)
+	{
+		m_converted = PrepareForEncode(pImage);
+		m_plane.data = static_cast<const uint8_t *>(m_converted->GetData());
+		m_plane.width = static_cast<unsigned int>(m_converted->GetWidth());
+		m_plane.height = static_cast<unsigned int>(m_converted->GetHeight());
+		m_plane.stride = m_converted->GetStride();
+		return m_plane;
+	}
+
+	Spinnaker::ImagePtr PrepareForEncode(const Spinnaker::ImagePtr & pImage)
+	{
+		return pImage->Convert(Spinnaker::PixelFormat_Mono8, Spinnaker::HQ_LINEAR);
+	}
+
+private:
+	Spinnaker::PixelFormatEnums m_format;
+	Spinnaker::ImagePtr m_converted;
+	LumaPlane m_plane;
+};
+
+// Selects the pipeline of a pixel format. The caller owns the result.
+inline FrameProcessor * CreateFramePipeline(Spinnaker::PixelFormatEnums format)
+{
+	switch (format)
+	{
+	case Spinnaker::PixelFormat_Mono8:
+		return new FramePipeline<false, 8>(format);
+	case Spinnaker::PixelFormat_Mono12p:
+		return new FramePipeline<false, 12>(format);
+	case Spinnaker::PixelFormat_BayerRG8:
+		return new FramePipeline<true, 8>(format);
+	case Spinnaker::PixelFormat_BayerRG12p:
+		return new FramePipeline<true, 12>(format);
+	default:
+		return new GenericFramePipeline(format);
+	}
+}
+
+#endif // FRAME_PIPELINE_H
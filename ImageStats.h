@@ -0,0 +1,115 @@
+//=============================================================================
+// ImageStats.h
+//
+// Per-frame brightness statistics used by the auto-exposure controller of
+// Trigger.cpp. Statistics are computed on a subsampled grid of an 8-bit
+// image: every k_statsRowStep-th row is scanned completely with SSE2 for the
+// mean and the saturated pixel count, and every k_statsColumnStep-th pixel of
+// those rows goes into the histogram.
+//=============================================================================
+
+#ifndef IMAGE_STATS_H
+#define IMAGE_STATS_H
+
+#include <stdint.h>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_STATS_SSE2
+#endif
+
+const unsigned int k_statsRowStep = 8;
+const unsigned int k_statsColumnStep = 4;
+
+// Pixel values at or above this level count as saturated.
+const uint8_t k_saturationLevel = 250;
+
+struct ImageStats
+{
+	uint32_t histogram[256];
+	uint64_t sum;				// sum of all sampled pixels
+	uint32_t samples;			// number of sampled pixels
+	uint32_t saturated;			// sampled pixels at or above k_saturationLevel
+
+	double Mean() const
+	{
+		return samples > 0 ? static_cast<double>(sum) / samples : 0.0;
+	}
+
+	double SaturatedFraction() const
+	{
+		return samples > 0 ? static_cast<double>(saturated) / samples : 0.0;
+	}
+};
+
+// Sums a row and counts its saturated pixels.
+inline void AccumulateRow(const uint8_t * row, unsigned int width, uint64_t & sum, uint32_t & saturated)
+{
+	unsigned int x = 0;
+
+#ifdef IMAGE_STATS_SSE2
+	// _mm_sad_epu8 against zero sums 8 bytes into each 64-bit half; the
+	// saturation test relies on max(v, level) == v for v >= level
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i level = _mm_set1_epi8(static_cast<char>(k_saturationLevel));
+	__m128i sums = _mm_setzero_si128();
+	__m128i counts = _mm_setzero_si128();
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+		sums = _mm_add_epi64(sums, _mm_sad_epu8(pixels, zero));
+		__m128i isSaturated = _mm_cmpeq_epi8(_mm_max_epu8(pixels, level), pixels);
+		counts = _mm_add_epi64(counts, _mm_sad_epu8(_mm_and_si128(isSaturated, _mm_set1_epi8(1)), zero));
+	}
+	uint64_t lanes[2];
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), sums);
+	sum += lanes[0] + lanes[1];
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), counts);
+	saturated += static_cast<uint32_t>(lanes[0] + lanes[1]);
+#endif
+
+	for (; x < width; x++)
+	{
+		sum += row[x];
+		saturated += row[x] >= k_saturationLevel ? 1 : 0;
+	}
+}
+
+// Computes the statistics of an 8-bit image with the given row stride.
+inline void ComputeImageStats(const uint8_t * data, unsigned int width, unsigned int height, size_t stride, ImageStats & stats)
+{
+	memset(&stats, 0, sizeof(stats));
+
+	// Four interleaved histograms avoid stalls on repeated increments of the
+	// same bin
+	uint32_t histograms[4][256];
+	memset(histograms, 0, sizeof(histograms));
+
+	for (unsigned int y = 0; y < height; y += k_statsRowStep)
+	{
+		const uint8_t * row = data + y * stride;
+		AccumulateRow(row, width, stats.sum, stats.saturated);
+		stats.samples += width;
+
+		unsigned int x = 0;
+		for (; x + 4 * k_statsColumnStep <= width; x += 4 * k_statsColumnStep)
+		{
+			histograms[0][row[x]]++;
+			histograms[1][row[x + k_statsColumnStep]]++;
+			histograms[2][row[x + 2 * k_statsColumnStep]]++;
+			histograms[3][row[x + 3 * k_statsColumnStep]]++;
+		}
+		for (; x < width; x += k_statsColumnStep)
+		{
+			histograms[0][row[x]]++;
+		}
+	}
+
+	for (unsigned int i = 0; i < 256; i++)
+	{
+		stats.histogram[i] = histograms[0][i] + histograms[1][i] + histograms[2][i] + histograms[3][i];
+	}
+}
+
+#endif // IMAGE_STATS_H
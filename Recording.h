@@ -0,0 +1,274 @@
+//=============================================================================
+// Recording.h
+//
+// On-disk layout of segmented recordings. The recording of each camera is
+// split into segment files <base>-<nnnn>.seg, each a SegmentHeader followed by
+// frames. A frame is a SegmentFrameHeader followed by the raw image data,
+// padded to k_segmentAlignment bytes. Segments are preallocated, so a segment
+// that was never finalized (e.g. after a crash) ends at the first frame header
+// whose magic is zero. Finalized segments are truncated to their length and
+// get an index file <base>-<nnnn>.idx: a SegmentIndexHeader followed by one
+// SegmentIndexEntry per frame. All values are little-endian.
+//
+// Since version 2 every frame carries the CRC32C of its image data, in its
+// frame header and in its index entry. The CRC32C uses the SSE4.2 crc32
+// instruction when the CPU has it.
+//=============================================================================
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include "FrameMetadata.h"
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define RECORDING_CRC32C_SSE42
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define RECORDING_TARGET_SSE42
+#else
+#include <cpuid.h>
+#define RECORDING_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#endif
+
+// "CSRS", "CSFR" and "CSRI" in file order
+const uint32_t k_segmentMagic = 0x53525343;
+const uint32_t k_segmentFrameMagic = 0x52465343;
+const uint32_t k_segmentIndexMagic = 0x49525343;
+const uint32_t k_segmentVersion = 2;
+
+// Frame headers start on this boundary, so image data can be used in place
+// from a mapped segment.
+const uint32_t k_segmentAlignment = 16;
+
+#pragma pack(push, 1)
+
+struct SegmentHeader
+{
+	uint32_t magic;				// k_segmentMagic
+	uint32_t version;			// k_segmentVersion
+	uint32_t frameHeaderSize;	// sizeof(SegmentFrameHeader)
+	uint32_t cameraIndex;		// index of the camera in the camera list
+	char serialNumber[16];		// device serial number, zero padded
+	uint32_t segmentIndex;		// position of the segment in the recording
+	uint32_t reserved;
+	int64_t createdAt;			// host wall-clock ns since the epoch
+};
+
+struct SegmentFrameHeader
+{
+	uint32_t magic;				// k_segmentFrameMagic
+	uint32_t dataSize;			// image bytes following the header
+	uint64_t setSequence;		// synchronized set the frame belongs to
+	uint32_t width;
+	uint32_t height;
+	uint32_t pixelFormat;		// Spinnaker PixelFormatEnums value
+	uint32_t checksum;			// CRC32C of the image data
+	FrameMetadataRecord metadata;
+};
+
+struct SegmentIndexHeader
+{
+	uint32_t magic;				// k_segmentIndexMagic
+	uint32_t version;			// k_segmentVersion
+	uint32_t entrySize;			// sizeof(SegmentIndexEntry)
+	uint32_t cameraIndex;
+	char serialNumber[16];
+	uint32_t segmentIndex;
+	uint32_t frameCount;		// number of entries that follow
+	uint64_t segmentSize;		// length of the finalized segment file
+	uint32_t segmentChecksum;	// CRC32C of the whole segment file
+	uint32_t reserved;
+};
+
+struct SegmentIndexEntry
+{
+	uint64_t offset;			// file offset of the SegmentFrameHeader
+	uint64_t setSequence;
+	uint64_t frameId;
+	uint64_t timestamp;			// camera clock in ns
+	int64_t hostTimestamp;		// host wall-clock ns, 0 if not synchronized
+	uint32_t dataSize;
+	uint32_t imageCnt;
+	uint32_t checksum;			// CRC32C of the image data
+	uint32_t reserved;
+};
+
+#pragma pack(pop)
+
+inline uint64_t SegmentAlign(uint64_t size)
+{
+	return (size + k_segmentAlignment - 1) & ~static_cast<uint64_t>(k_segmentAlignment - 1);
+}
+
+inline std::string SegmentPath(const std::string & fileBase, uint32_t segmentIndex)
+{
+	char suffix[16];
+	snprintf(suffix, sizeof(suffix), "-%04u.seg", segmentIndex);
+	return fileBase + suffix;
+}
+
+inline std::string SegmentIndexPath(const std::string & fileBase, uint32_t segmentIndex)
+{
+	char suffix[16];
+	snprintf(suffix, sizeof(suffix), "-%04u.idx", segmentIndex);
+	return fileBase + suffix;
+}
+
+// Lookup table of the bytewise CRC32C (Castagnoli) update.
+struct Crc32cTable
+{
+	uint32_t values[256];
+
+	Crc32cTable()
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t value = i;
+			for (int bit = 0; bit < 8; bit++)
+			{
+				value = (value & 1) ? (value >> 1) ^ 0x82F63B78 : value >> 1;
+			}
+			values[i] = value;
+		}
+	}
+};
+
+inline uint32_t Crc32cSoftware(uint32_t crc, const void * data, size_t size)
+{
+	static const Crc32cTable table;
+
+	const uint8_t * bytes = static_cast<const uint8_t *>(data);
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+	{
+		crc = table.values[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+#ifdef RECORDING_CRC32C_SSE42
+inline bool DetectSse42()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 20)) != 0;
+#else
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+}
+
+// Eight bytes per crc32 instruction once the data is aligned.
+RECORDING_TARGET_SSE42 inline uint32_t Crc32cSse42(uint32_t crc, const void * data, size_t size)
+{
+	const uint8_t * bytes = static_cast<const uint8_t *>(data);
+	uint64_t value = ~crc & 0xFFFFFFFFu;
+	for (; size > 0 && (reinterpret_cast<uintptr_t>(bytes) & 7) != 0; size--)
+	{
+		value = _mm_crc32_u8(static_cast<uint32_t>(value), *bytes++);
+	}
+	for (; size >= 8; size -= 8, bytes += 8)
+	{
+		uint64_t word;
+		memcpy(&word, bytes, sizeof(word));
+		value = _mm_crc32_u64(value, word);
+	}
+	for (; size > 0; size--)
+	{
+		value = _mm_crc32_u8(static_cast<uint32_t>(value), *bytes++);
+	}
+	return ~static_cast<uint32_t>(value);
+}
+#endif
+
+// Updates a CRC32C with the given bytes. Start with crc = 0.
+inline uint32_t Crc32c(uint32_t crc, const void * data, size_t size)
+{
+#ifdef RECORDING_CRC32C_SSE42
+	static const bool hardware = DetectSse42();
+	if (hardware)
+	{
+		return Crc32cSse42(crc, data, size);
+	}
+#endif
+	return Crc32cSoftware(crc, data, size);
+}
+
+inline uint32_t Crc32cMatrixTimes(const uint32_t * matrix, uint32_t vector)
+{
+	uint32_t sum = 0;
+	for (; vector != 0; vector >>= 1, matrix++)
+	{
+		if (vector & 1)
+		{
+			sum ^= *matrix;
+		}
+	}
+	return sum;
+}
+
+inline void Crc32cMatrixSquare(uint32_t * square, const uint32_t * matrix)
+{
+	for (int n = 0; n < 32; n++)
+	{
+		square[n] = Crc32cMatrixTimes(matrix, matrix[n]);
+	}
+}
+
+// Returns the CRC32C of two byte ranges back to back from the CRC32C of
+// each and the length of the second, so that ranges checksummed apart, e.g.
+// on different threads, add up to the checksum of the whole. Takes time
+// logarithmic in the length, as in zlib's crc32_combine().
+inline uint32_t Crc32cCombine(uint32_t crc1, uint32_t crc2, uint64_t size2)
+{
+	if (size2 == 0)
+	{
+		return crc1;
+	}
+
+	// Operator for one zero bit, then squared to two and four bits
+	uint32_t even[32];
+	uint32_t odd[32];
+	odd[0] = 0x82F63B78;
+	uint32_t row = 1;
+	for (int n = 1; n < 32; n++)
+	{
+		odd[n] = row;
+		row <<= 1;
+	}
+	Crc32cMatrixSquare(even, odd);
+	Crc32cMatrixSquare(odd, even);
+
+	// Apply the operator for 2^k zero bytes for every bit k set in size2
+	do
+	{
+		Crc32cMatrixSquare(even, odd);
+		if (size2 & 1)
+		{
+			crc1 = Crc32cMatrixTimes(even, crc1);
+		}
+		size2 >>= 1;
+		if (size2 == 0)
+		{
+			break;
+		}
+		Crc32cMatrixSquare(odd, even);
+		if (size2 & 1)
+		{
+			crc1 = Crc32cMatrixTimes(odd, crc1);
+		}
+		size2 >>= 1;
+	} while (size2 != 0);
+
+	return crc1 ^ crc2;
+}
+
+#endif // RECORDING_H
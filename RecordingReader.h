@@ -0,0 +1,344 @@
+//=============================================================================
+// RecordingReader.h
+//
+// Read side of the segmented recordings described in Recording.h, shared by
+// the offline tools. A SegmentReader maps a segment file and lists its frames
+// in place. It takes the frame offsets from the segment's index when the
+// segment was finalized, and otherwise walks the frame headers up to the
+// first one with a zero magic, which is where an unfinalized, preallocated
+// segment ends. The index is kept even when it does not match the segment,
+// and the reader notes where a scan stopped, so that the verifier can tell
+// the end of a segment from damage in it.
+//
+// Segments are mapped copy-on-write, so the image data can be handed to APIs
+// that take a non-const buffer without ever modifying the file. Segments of
+// version 1 are still read; their frames carry no checksum.
+//=============================================================================
+
+#ifndef RECORDING_READER_H
+#define RECORDING_READER_H
+
+#include "Recording.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Read-only, copy-on-write mapping of a whole file.
+class MappedFile
+{
+public:
+	MappedFile() : m_data(NULL), m_size(0), m_handle(NULL) {}
+	~MappedFile() { Close(); }
+
+	bool Open(const std::string & path)
+	{
+		Close();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		{
+			CloseHandle(file);
+			return false;
+		}
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		CloseHandle(file);
+		if (mapping == NULL)
+		{
+			return false;
+		}
+		void * view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		if (view == NULL)
+		{
+			CloseHandle(mapping);
+			return false;
+		}
+		m_handle = mapping;
+		m_data = static_cast<uint8_t *>(view);
+		m_size = static_cast<uint64_t>(size.QuadPart);
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0)
+		{
+			close(fd);
+			return false;
+		}
+		void * view = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (view == MAP_FAILED)
+		{
+			return false;
+		}
+		madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+		m_data = static_cast<uint8_t *>(view);
+		m_size = static_cast<uint64_t>(info.st_size);
+#endif
+		return true;
+	}
+
+	void Close()
+	{
+		if (m_data == NULL)
+		{
+			return;
+		}
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+		CloseHandle(static_cast<HANDLE>(m_handle));
+#else
+		munmap(m_data, static_cast<size_t>(m_size));
+#endif
+		m_data = NULL;
+		m_size = 0;
+		m_handle = NULL;
+	}
+
+	uint8_t * Data() const { return m_data; }
+	uint64_t Size() const { return m_size; }
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile & operator=(const MappedFile &);
+
+	uint8_t * m_data;
+	uint64_t m_size;
+	void * m_handle;
+};
+
+// A frame of a mapped segment.
+struct SegmentFrame
+{
+	const SegmentFrameHeader * header;
+	uint8_t * data;
+	uint64_t offset;
+	const SegmentIndexEntry * entry;	// NULL if found by scan
+};
+
+// Returns the index path of a segment path ending in ".seg".
+inline std::string SegmentIndexPathOf(const std::string & segmentPath)
+{
+	std::string::size_type dot = segmentPath.rfind(".seg");
+	if (dot == std::string::npos || dot + 4 != segmentPath.size())
+	{
+		return "";
+	}
+	return segmentPath.substr(0, dot) + ".idx";
+}
+
+// Reads the index of a finalized segment. Returns false if there is none or
+// it does not belong to a segment of this version. The entries are read up to
+// the end of the file, so they may disagree with header.frameCount.
+inline bool ReadSegmentIndex(const std::string & indexPath, SegmentIndexHeader & header, std::vector<SegmentIndexEntry> & entries)
+{
+	entries.clear();
+	FILE * file = fopen(indexPath.c_str(), "rb");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == k_segmentIndexMagic
+		&& header.version == k_segmentVersion && header.entrySize == sizeof(SegmentIndexEntry);
+	if (valid)
+	{
+		SegmentIndexEntry entry;
+		while (fread(&entry, sizeof(entry), 1, file) == 1)
+		{
+			entries.push_back(entry);
+		}
+	}
+	fclose(file);
+	return valid;
+}
+
+inline bool FileExists(const std::string & path)
+{
+	FILE * file = fopen(path.c_str(), "rb");
+	if (file == NULL)
+	{
+		return false;
+	}
+	fclose(file);
+	return true;
+}
+
+class SegmentReader
+{
+public:
+	SegmentReader() : m_hasIndex(false), m_indexed(false), m_indexRejected(false), m_scanEnd(0)
+	{
+		memset(&m_indexHeader, 0, sizeof(m_indexHeader));
+	}
+
+	// Maps a segment and lists its frames.
+	bool Open(const std::string & path)
+	{
+		m_frames.clear();
+		m_entries.clear();
+		m_damagedEntries.clear();
+		m_hasIndex = false;
+		m_indexed = false;
+		m_indexRejected = false;
+		m_scanEnd = 0;
+		if (!m_file.Open(path) || m_file.Size() < sizeof(SegmentHeader))
+		{
+			return false;
+		}
+
+		const SegmentHeader * header = reinterpret_cast<const SegmentHeader *>(m_file.Data());
+		if (header->magic != k_segmentMagic || header->version < 1 || header->version > k_segmentVersion || header->frameHeaderSize != sizeof(SegmentFrameHeader))
+		{
+			m_file.Close();
+			return false;
+		}
+
+		std::string indexPath = SegmentIndexPathOf(path);
+		if (ReadSegmentIndex(indexPath, m_indexHeader, m_entries))
+		{
+			m_hasIndex = true;
+			m_indexed = m_indexHeader.segmentSize == m_file.Size() && m_indexHeader.frameCount == m_entries.size();
+			for (size_t i = 0; m_indexed && i < m_entries.size(); i++)
+			{
+				// Entries without a valid frame header are skipped, so that
+				// damage in one frame does not hide the frames after it
+				if (!AddFrame(m_entries[i].offset, &m_entries[i]))
+				{
+					m_damagedEntries.push_back(i);
+				}
+			}
+		}
+		if (!m_indexed && header->version == k_segmentVersion && FileExists(indexPath))
+		{
+			// The index does not match the segment; fall back to a scan
+			m_indexRejected = true;
+		}
+
+		if (!m_indexed)
+		{
+			uint64_t offset = SegmentAlign(sizeof(SegmentHeader));
+			while (AddFrame(offset, NULL))
+			{
+				offset += SegmentAlign(sizeof(SegmentFrameHeader) + static_cast<uint64_t>(m_frames.back().header->dataSize));
+			}
+			m_scanEnd = offset;
+		}
+		return true;
+	}
+
+	// Looks up the frame whose header is at offset. Returns false if there is
+	// no valid frame header or the frame runs past the end of the file.
+	bool FrameAt(uint64_t offset, SegmentFrame & frame) const
+	{
+		if (offset + sizeof(SegmentFrameHeader) > m_file.Size())
+		{
+			return false;
+		}
+		frame.header = reinterpret_cast<const SegmentFrameHeader *>(m_file.Data() + offset);
+		frame.data = m_file.Data() + offset + sizeof(SegmentFrameHeader);
+		frame.offset = offset;
+		frame.entry = NULL;
+		return frame.header->magic == k_segmentFrameMagic && offset + sizeof(SegmentFrameHeader) + frame.header->dataSize <= m_file.Size();
+	}
+
+	// Finds the first frame at or after offset, for picking up the frames
+	// that follow a damaged region.
+	bool FindFrame(uint64_t offset, SegmentFrame & frame) const
+	{
+		for (offset = SegmentAlign(offset); offset + sizeof(SegmentFrameHeader) <= m_file.Size(); offset += k_segmentAlignment)
+		{
+			if (FrameAt(offset, frame))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Close()
+	{
+		m_frames.clear();
+		m_entries.clear();
+		m_damagedEntries.clear();
+		m_file.Close();
+	}
+
+	const SegmentHeader & Header() const { return *reinterpret_cast<const SegmentHeader *>(m_file.Data()); }
+	const std::vector<SegmentFrame> & Frames() const { return m_frames; }
+	const MappedFile & File() const { return m_file; }
+
+	// True if the index of the segment could be read, whether or not it
+	// matches the segment.
+	bool HasIndex() const { return m_hasIndex; }
+
+	// True if the frames were listed from a matching index.
+	bool Indexed() const { return m_indexed; }
+
+	// True if an index exists but does not match the segment.
+	bool IndexRejected() const { return m_indexRejected; }
+
+	const SegmentIndexHeader & IndexHeader() const { return m_indexHeader; }
+
+	// Entries of the index as read, also when it was rejected. Frames listed
+	// from the index refer to theirs through SegmentFrame::entry.
+	const std::vector<SegmentIndexEntry> & IndexEntries() const { return m_entries; }
+
+	// Positions in IndexEntries() of the entries of a matching index that
+	// have no valid frame header at their offset.
+	const std::vector<size_t> & DamagedEntries() const { return m_damagedEntries; }
+
+	// Offset at which the scan for frames stopped, unless Indexed(). Only
+	// zero bytes follow it in an intact segment.
+	uint64_t ScanEnd() const { return m_scanEnd; }
+
+	// True if the frames carry a checksum of their image data.
+	bool HasChecksums() const { return Header().version >= 2; }
+
+private:
+	bool AddFrame(uint64_t offset, const SegmentIndexEntry * entry)
+	{
+		SegmentFrame frame;
+		if (!FrameAt(offset, frame))
+		{
+			return false;
+		}
+		frame.entry = entry;
+		m_frames.push_back(frame);
+		return true;
+	}
+
+	MappedFile m_file;
+	std::vector<SegmentFrame> m_frames;
+	SegmentIndexHeader m_indexHeader;
+	std::vector<SegmentIndexEntry> m_entries;
+	std::vector<size_t> m_damagedEntries;
+	bool m_hasIndex;
+	bool m_indexed;
+	bool m_indexRejected;
+	uint64_t m_scanEnd;
+};
+
+#endif // RECORDING_READER_H
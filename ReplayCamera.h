@@ -0,0 +1,207 @@
+//=============================================================================
+// ReplayCamera.h
+//
+// Replay source for the segmented recordings read through RecordingReader.h.
+// A ReplayCamera stands in for the Spinnaker camera of one recorded device in
+// the acquisition loop of Trigger.cpp: BeginAcquisition() starts the replay
+// clock and GetNextImage() hands out the recorded frames in order, as
+// Spinnaker images wrapping the mapped data, together with their metadata
+// record and synchronized set. Frames are paced by their recorded host
+// timestamps, measured from a base shared by all cameras of the replay and
+// divided by a speed factor; a speed of 0 replays as fast as the pipeline can
+// take the frames. The host timestamps stay comparable across cameras and
+// across camera resets, unlike the camera clocks. Frames recorded before the
+// camera clock was synchronized carry no host timestamp and are not paced.
+// Only the segment being replayed is mapped.
+//=============================================================================
+
+#ifndef REPLAY_CAMERA_H
+#define REPLAY_CAMERA_H
+
+#include "RecordingReader.h"
+#include "Spinnaker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ReplayCamera
+{
+public:
+	ReplayCamera() : m_speed(1.0), m_segment(0), m_frame(0), m_streaming(false), m_baseTimestamp(0),
+		m_maxFrameSize(0), m_pixelFormat(0), m_deliveredFrames(0), m_lateFrames(0), m_maxLagNs(0) {}
+
+	// Opens the recording of one camera. Segments are replayed in name
+	// order, which is recording order for the names written by
+	// SegmentWriter.
+	bool Open(const std::vector<std::string> & segmentPaths)
+	{
+		m_paths = segmentPaths;
+		std::sort(m_paths.begin(), m_paths.end());
+		m_segment = 0;
+		m_frame = 0;
+		if (m_paths.empty() || !m_reader.Open(m_paths[0]))
+		{
+			return false;
+		}
+
+		char serialNumber[sizeof(m_reader.Header().serialNumber) + 1];
+		memcpy(serialNumber, m_reader.Header().serialNumber, sizeof(m_reader.Header().serialNumber));
+		serialNumber[sizeof(serialNumber) - 1] = '\0';
+		m_serialNumber = serialNumber;
+
+		// Frame sizes and formats do not change within a session
+		const std::vector<SegmentFrame> & frames = m_reader.Frames();
+		m_pixelFormat = frames.empty() ? 0 : frames[0].header->pixelFormat;
+		m_maxFrameSize = 0;
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			m_maxFrameSize = std::max(m_maxFrameSize, frames[i].header->dataSize);
+		}
+		return true;
+	}
+
+	// Sets the replay speed: 1 for the original timing, 0 for no pacing.
+	void SetSpeed(double speed)
+	{
+		m_speed = speed;
+	}
+
+	// Returns the first host timestamp of the recording, or 0 if the first
+	// segment has none.
+	int64_t FirstHostTimestamp() const
+	{
+		const std::vector<SegmentFrame> & frames = m_reader.Frames();
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			if (frames[i].header->metadata.hostTimestamp > 0)
+			{
+				return frames[i].header->metadata.hostTimestamp;
+			}
+		}
+		return 0;
+	}
+
+	// Starts the replay clock. Cameras replayed together share the start
+	// time and the base timestamp, the earliest FirstHostTimestamp() of all
+	// of them, so that their frames stay aligned.
+	void BeginAcquisition(std::chrono::steady_clock::time_point start, int64_t baseTimestamp)
+	{
+		m_start = start;
+		m_baseTimestamp = baseTimestamp;
+		m_streaming = true;
+	}
+
+	void EndAcquisition()
+	{
+		m_streaming = false;
+		m_reader.Close();
+	}
+
+	bool IsStreaming() const
+	{
+		return m_streaming;
+	}
+
+	// Returns the synchronized set of the next frame, or false at the end of
+	// the recording.
+	bool PeekSetSequence(uint64_t & setSequence)
+	{
+		const SegmentFrame * frame = NextFrame();
+		if (frame == NULL)
+		{
+			return false;
+		}
+		setSequence = frame->header->setSequence;
+		return true;
+	}
+
+	// Waits until the next frame is due and returns it. Returns false at the
+	// end of the recording. The image wraps the mapped segment and stays
+	// valid until the replay moves on to the next segment.
+	bool GetNextImage(Spinnaker::ImagePtr & image, FrameMetadataRecord & record, uint64_t & setSequence)
+	{
+		const SegmentFrame * frame = NextFrame();
+		if (!m_streaming || frame == NULL)
+		{
+			return false;
+		}
+		const SegmentFrameHeader & header = *frame->header;
+
+		if (m_speed > 0.0 && m_baseTimestamp > 0 && header.metadata.hostTimestamp > 0)
+		{
+			int64_t offsetNs = std::max<int64_t>(header.metadata.hostTimestamp - m_baseTimestamp, 0);
+			std::chrono::steady_clock::time_point due = m_start + std::chrono::nanoseconds(static_cast<int64_t>(offsetNs / m_speed));
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (now < due)
+			{
+				std::this_thread::sleep_until(due);
+			}
+			else
+			{
+				// The pipeline did not keep up with the recorded rate
+				int64_t lagNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - due).count();
+				m_lateFrames += lagNs > k_replayLateNs ? 1 : 0;
+				m_maxLagNs = std::max(m_maxLagNs, lagNs);
+			}
+		}
+
+		image = Spinnaker::Image::Create(header.width, header.height, 0, 0, static_cast<Spinnaker::PixelFormatEnums>(header.pixelFormat), frame->data);
+		record = header.metadata;
+		setSequence = header.setSequence;
+		m_frame++;
+		m_deliveredFrames++;
+		return true;
+	}
+
+	const std::string & SerialNumber() const { return m_serialNumber; }
+	uint32_t MaxFrameSize() const { return m_maxFrameSize; }
+	uint32_t PixelFormat() const { return m_pixelFormat; }
+	uint64_t DeliveredFrames() const { return m_deliveredFrames; }
+	uint64_t LateFrames() const { return m_lateFrames; }
+	double MaxLagMs() const { return m_maxLagNs / 1e6; }
+
+private:
+	// Frames delivered more than this late count as late.
+	static const int64_t k_replayLateNs = 1000000;
+
+	// Returns the next frame, moving on to the next segment as needed.
+	const SegmentFrame * NextFrame()
+	{
+		while (m_segment < m_paths.size())
+		{
+			if (m_frame < m_reader.Frames().size())
+			{
+				return &m_reader.Frames()[m_frame];
+			}
+			m_frame = 0;
+			m_reader.Close();
+			if (++m_segment < m_paths.size() && !m_reader.Open(m_paths[m_segment]))
+			{
+				m_segment = m_paths.size();
+			}
+		}
+		return NULL;
+	}
+
+	std::vector<std::string> m_paths;
+	SegmentReader m_reader;
+	std::string m_serialNumber;
+	double m_speed;
+	size_t m_segment;
+	size_t m_frame;
+
+	bool m_streaming;
+	std::chrono::steady_clock::time_point m_start;
+	int64_t m_baseTimestamp;
+
+	uint32_t m_maxFrameSize;
+	uint32_t m_pixelFormat;
+	uint64_t m_deliveredFrames;
+	uint64_t m_lateFrames;
+	int64_t m_maxLagNs;
+};
+
+#endif // REPLAY_CAMERA_H
@@ -0,0 +1,724 @@
+//=============================================================================
+// SegmentWriter.h
+//
+// Writer side of the segmented recordings described in Recording.h, used by
+// Trigger.cpp. A SegmentWriter appends frames of one camera to the current
+// segment and rolls over to the next one by size or duration. The next
+// segment is created and preallocated on a SegmentFinalizer thread as soon
+// as the current one is opened, so rollover is a pointer swap on the
+// acquisition thread. Closed segments are handed to a second, low-priority
+// thread, which truncates them, checksums them, writes their index and
+// optionally runs a command on them (e.g. a compressor). DiskForecaster
+// predicts when the target disk will be full at the current write rate.
+//=============================================================================
+
+#ifndef SEGMENT_WRITER_H
+#define SEGMENT_WRITER_H
+
+#include "Recording.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/statvfs.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Buffer size of segment files, and of the read-back when checksumming.
+const size_t k_segmentBufferSize = 1 << 20;
+
+// True where PreallocateFile() reserves the disk space of a file rather
+// than leaving it sparse.
+#if defined(_WIN32) || defined(__linux__)
+const bool k_preallocationReserves = true;
+#else
+const bool k_preallocationReserves = false;
+#endif
+
+inline bool PreallocateFile(FILE * file, uint64_t size)
+{
+#ifdef _WIN32
+	return _chsize_s(_fileno(file), static_cast<__int64>(size)) == 0;
+#elif defined(__linux__)
+	return posix_fallocate(fileno(file), 0, static_cast<off_t>(size)) == 0;
+#else
+	return ftruncate(fileno(file), static_cast<off_t>(size)) == 0;
+#endif
+}
+
+inline bool SeekFile(FILE * file, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+	return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+inline bool TruncateFile(FILE * file, uint64_t size)
+{
+#ifdef _WIN32
+	return _chsize_s(_fileno(file), static_cast<__int64>(size)) == 0;
+#else
+	return ftruncate(fileno(file), static_cast<off_t>(size)) == 0;
+#endif
+}
+
+// Returns the free bytes on the disk holding the given file prefix.
+inline bool FreeDiskBytes(const std::string & filePrefix, uint64_t & freeBytes)
+{
+	std::string directory = ".";
+	std::string::size_type slash = filePrefix.find_last_of("/\\");
+	if (slash != std::string::npos)
+	{
+		directory = filePrefix.substr(0, slash + 1);
+	}
+
+#ifdef _WIN32
+	ULARGE_INTEGER available;
+	if (!GetDiskFreeSpaceExA(directory.c_str(), &available, NULL, NULL))
+	{
+		return false;
+	}
+	freeBytes = available.QuadPart;
+#else
+	struct statvfs info;
+	if (statvfs(directory.c_str(), &info) != 0)
+	{
+		return false;
+	}
+	freeBytes = static_cast<uint64_t>(info.f_bavail) * info.f_frsize;
+#endif
+	return true;
+}
+
+// Runs a command on a file without a shell: the command is split at spaces
+// into the program and its arguments, and the path is passed as the last
+// argument as it is. The program is looked up in PATH. Returns the exit
+// status of the program, or -1 if it could not be run.
+inline int RunFileCommand(const std::string & command, const std::string & path)
+{
+	std::vector<std::string> args;
+	std::istringstream words(command);
+	std::string word;
+	while (words >> word)
+	{
+		args.push_back(word);
+	}
+	if (args.empty())
+	{
+		return -1;
+	}
+	args.push_back(path);
+
+#ifdef _WIN32
+	// Quote every argument; paths cannot contain quotes on Windows
+	std::string commandLine;
+	for (size_t i = 0; i < args.size(); i++)
+	{
+		commandLine += (i > 0 ? " \"" : "\"") + args[i] + "\"";
+	}
+	STARTUPINFOA startup;
+	memset(&startup, 0, sizeof(startup));
+	startup.cb = sizeof(startup);
+	PROCESS_INFORMATION process;
+	std::vector<char> commandBuffer(commandLine.begin(), commandLine.end());
+	commandBuffer.push_back('\0');
+	if (!CreateProcessA(NULL, &commandBuffer[0], NULL, NULL, FALSE, 0, NULL, NULL, &startup, &process))
+	{
+		return -1;
+	}
+	WaitForSingleObject(process.hProcess, INFINITE);
+	DWORD exitCode = 0;
+	GetExitCodeProcess(process.hProcess, &exitCode);
+	CloseHandle(process.hThread);
+	CloseHandle(process.hProcess);
+	return static_cast<int>(exitCode);
+#else
+	std::vector<char *> argv;
+	for (size_t i = 0; i < args.size(); i++)
+	{
+		argv.push_back(const_cast<char *>(args[i].c_str()));
+	}
+	argv.push_back(NULL);
+
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		return -1;
+	}
+	if (pid == 0)
+	{
+		execvp(argv[0], &argv[0]);
+		_exit(127);
+	}
+	int status = 0;
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+	{
+		return -1;
+	}
+	return WEXITSTATUS(status);
+#endif
+}
+
+// This class runs the background threads that prepare and finalize
+// segments. Preparing the next segment runs on a thread of normal priority,
+// since the acquisition thread may be waiting for it; finalization reads
+// whole segments back and runs on a low-priority thread, so that it neither
+// competes with acquisition nor delays preparation.
+class SegmentFinalizer
+{
+public:
+	SegmentFinalizer() : m_stop(false), m_running(false) {}
+	~SegmentFinalizer() { Stop(); }
+
+	void Start()
+	{
+		if (m_running)
+		{
+			return;
+		}
+		m_stop = false;
+		m_running = true;
+		m_prepareThread = std::thread(&SegmentFinalizer::Run, this, &m_prepareJobs, false);
+		m_finalizeThread = std::thread(&SegmentFinalizer::Run, this, &m_finalizeJobs, true);
+	}
+
+	// Finishes all queued work and joins the threads.
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+			m_wake.notify_all();
+		}
+		if (m_prepareThread.joinable())
+		{
+			m_prepareThread.join();
+		}
+		if (m_finalizeThread.joinable())
+		{
+			m_finalizeThread.join();
+		}
+		m_running = false;
+	}
+
+	// Queues work on a segment that is about to be written. Jobs run in
+	// order.
+	void Prepare(const std::function<void()> & job)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_prepareJobs.push_back(job);
+		m_wake.notify_all();
+	}
+
+	// Queues work on a closed segment. Jobs run in order.
+	void Post(const std::function<void()> & job)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_finalizeJobs.push_back(job);
+		m_wake.notify_all();
+	}
+
+private:
+	void Run(std::deque<std::function<void()> > * jobs, bool lowPriority)
+	{
+		if (lowPriority)
+		{
+#ifdef _WIN32
+			SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+			sched_param param;
+			param.sched_priority = 0;
+			pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			m_wake.wait(lock, [&] { return m_stop || !jobs->empty(); });
+			if (jobs->empty())
+			{
+				return;
+			}
+			std::function<void()> job = jobs->front();
+			jobs->pop_front();
+			lock.unlock();
+			job();
+			lock.lock();
+		}
+	}
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::deque<std::function<void()> > m_prepareJobs;
+	std::deque<std::function<void()> > m_finalizeJobs;
+	bool m_stop;
+	bool m_running;
+	std::thread m_prepareThread;
+	std::thread m_finalizeThread;
+};
+
+// This class writes the segments of one camera. Write() is called from the
+// acquisition thread only; the preparation thread hands the prepared next
+// segment over through m_next.
+class SegmentWriter
+{
+public:
+	SegmentWriter() : m_file(NULL), m_finalizer(NULL), m_cameraIndex(0), m_maxBytes(0), m_maxDurationNs(0),
+		m_segmentIndex(0), m_segmentBytes(0), m_reserved(false), m_totalBytes(0), m_segments(0), m_stalls(0), m_failures(0) {}
+	~SegmentWriter() { Close(); }
+
+	// Opens the first segment of a recording. Segments roll over once they
+	// would exceed maxBytes or are older than maxDurationNs; the command, if
+	// not empty, is run on every finalized segment with its path appended
+	// (see RunFileCommand()).
+	bool Open(const std::string & fileBase, const std::string & serialNumber, uint32_t cameraIndex, uint64_t maxBytes,
+		int64_t maxDurationNs, const std::string & finalizeCommand, SegmentFinalizer * finalizer)
+	{
+		Close();
+
+		m_fileBase = fileBase;
+		m_serialNumber = serialNumber;
+		m_cameraIndex = cameraIndex;
+		m_maxBytes = maxBytes;
+		m_maxDurationNs = maxDurationNs;
+		m_finalizeCommand = finalizeCommand;
+		m_finalizer = finalizer;
+		m_segmentIndex = 0;
+		m_totalBytes = 0;
+		m_segments = 0;
+		m_stalls = 0;
+		m_failures = 0;
+
+		// Waiting for the first segment does not count as a stall
+		m_next = std::make_shared<PreparedSegment>();
+		PrepareSegment(m_next, 0);
+		bool opened = BeginSegment();
+		m_stalls = 0;
+		return opened;
+	}
+
+	bool IsOpen() const
+	{
+		return m_file != NULL;
+	}
+
+	// Appends a frame, rolling over to the next segment first if needed.
+	bool Write(const FrameMetadataRecord & record, uint64_t setSequence, uint32_t width, uint32_t height,
+		uint32_t pixelFormat, const void * data, uint32_t dataSize)
+	{
+		if (m_file == NULL)
+		{
+			return false;
+		}
+
+		uint64_t frameBytes = SegmentAlign(sizeof(SegmentFrameHeader) + static_cast<uint64_t>(dataSize));
+		bool full = m_segmentBytes + frameBytes > m_maxBytes;
+		bool expired = m_maxDurationNs > 0 && Now() - m_openedAt >= m_maxDurationNs;
+		if (!m_index.empty() && (full || expired))
+		{
+			EndSegment();
+			if (!BeginSegment())
+			{
+				return false;
+			}
+		}
+
+		SegmentFrameHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = k_segmentFrameMagic;
+		header.dataSize = dataSize;
+		header.setSequence = setSequence;
+		header.width = width;
+		header.height = height;
+		header.pixelFormat = pixelFormat;
+		header.checksum = Crc32c(0, data, dataSize);
+		header.metadata = record;
+
+		static const char padding[k_segmentAlignment] = { 0 };
+		size_t paddingSize = static_cast<size_t>(frameBytes - sizeof(header) - dataSize);
+		if (fwrite(&header, sizeof(header), 1, m_file) != 1 || fwrite(data, 1, dataSize, m_file) != dataSize
+			|| fwrite(padding, 1, paddingSize, m_file) != paddingSize)
+		{
+			// Drop what was written of the frame, so that the index and the
+			// segment length stay in step with the file. If the file cannot
+			// be rewound, the segment ends before the frame.
+			m_failures++;
+			clearerr(m_file);
+			if (!SeekFile(m_file, m_segmentBytes))
+			{
+				EndSegment();
+				BeginSegment();
+			}
+			return false;
+		}
+
+		SegmentIndexEntry entry;
+		entry.offset = m_segmentBytes;
+		entry.setSequence = setSequence;
+		entry.frameId = record.frameId;
+		entry.timestamp = record.timestamp;
+		entry.hostTimestamp = record.hostTimestamp;
+		entry.dataSize = dataSize;
+		entry.imageCnt = record.imageCnt;
+		entry.checksum = header.checksum;
+		entry.reserved = 0;
+		m_index.push_back(entry);
+
+		m_segmentBytes += frameBytes;
+		m_totalBytes += frameBytes;
+		return true;
+	}
+
+	// Closes the current segment and queues its finalization. The prepared
+	// next segment is not needed anymore and is removed once it exists.
+	void Close()
+	{
+		if (m_file != NULL)
+		{
+			EndSegment();
+		}
+		if (!m_next)
+		{
+			return;
+		}
+
+		// Queued behind the preparation of the segment, so it runs after it
+		std::shared_ptr<PreparedSegment> next = m_next;
+		m_next.reset();
+		m_finalizer->Prepare([next]()
+		{
+			std::lock_guard<std::mutex> lock(next->mutex);
+			if (next->file != NULL)
+			{
+				fclose(next->file);
+				remove(next->path.c_str());
+			}
+		});
+	}
+
+	// Returns the preallocated bytes of the current and the prepared next
+	// segment that no frame uses yet. The disk counts them as used, but
+	// frames are written into them.
+	uint64_t ReservedBytes() const
+	{
+		uint64_t reserved = 0;
+		if (m_file != NULL && m_reserved && m_segmentBytes < m_maxBytes)
+		{
+			reserved += m_maxBytes - m_segmentBytes;
+		}
+		if (m_next)
+		{
+			std::lock_guard<std::mutex> lock(m_next->mutex);
+			if (m_next->ready && m_next->reserved)
+			{
+				reserved += m_maxBytes;
+			}
+		}
+		return reserved;
+	}
+
+	uint64_t TotalBytes() const { return m_totalBytes; }
+	unsigned int Segments() const { return m_segments; }
+	unsigned int Stalls() const { return m_stalls; }
+	unsigned int Failures() const { return m_failures; }
+
+private:
+	struct PreparedSegment
+	{
+		PreparedSegment() : ready(false), file(NULL), reserved(false) {}
+
+		std::mutex mutex;
+		std::condition_variable done;
+		bool ready;
+		FILE * file;
+		std::string path;
+		bool reserved;		// the preallocated space is taken from the disk
+	};
+
+	static int64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Queues creation of a segment file preallocated to the size limit.
+	void PrepareSegment(const std::shared_ptr<PreparedSegment> & next, uint32_t segmentIndex)
+	{
+		std::string path = SegmentPath(m_fileBase, segmentIndex);
+		uint64_t size = m_maxBytes;
+		m_finalizer->Prepare([next, path, size]()
+		{
+			FILE * file = fopen(path.c_str(), "wb");
+			bool reserved = false;
+			if (file != NULL)
+			{
+				setvbuf(file, NULL, _IOFBF, k_segmentBufferSize);
+				reserved = PreallocateFile(file, size) && k_preallocationReserves;
+			}
+
+			std::lock_guard<std::mutex> lock(next->mutex);
+			next->file = file;
+			next->path = path;
+			next->reserved = reserved;
+			next->ready = true;
+			next->done.notify_all();
+		});
+	}
+
+	// Takes over the prepared segment, writes its header and queues
+	// preparation of the one after it.
+	bool BeginSegment()
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_next->mutex);
+			if (!m_next->ready)
+			{
+				m_stalls++;
+				m_next->done.wait(lock, [&] { return m_next->ready; });
+			}
+			m_file = m_next->file;
+			m_path = m_next->path;
+			m_reserved = m_next->reserved;
+		}
+		if (m_file == NULL)
+		{
+			m_failures++;
+			return false;
+		}
+
+		m_next = std::make_shared<PreparedSegment>();
+		PrepareSegment(m_next, m_segmentIndex + 1);
+
+		SegmentHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = k_segmentMagic;
+		header.version = k_segmentVersion;
+		header.frameHeaderSize = sizeof(SegmentFrameHeader);
+		header.cameraIndex = m_cameraIndex;
+		strncpy(header.serialNumber, m_serialNumber.c_str(), sizeof(header.serialNumber));
+		header.segmentIndex = m_segmentIndex;
+		header.createdAt = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+		static const char padding[k_segmentAlignment] = { 0 };
+		m_segmentBytes = SegmentAlign(sizeof(header));
+		if (fwrite(&header, sizeof(header), 1, m_file) != 1 || fwrite(padding, 1, static_cast<size_t>(m_segmentBytes - sizeof(header)), m_file) != m_segmentBytes - sizeof(header))
+		{
+			m_failures++;
+		}
+		m_openedAt = Now();
+		m_index.clear();
+		return true;
+	}
+
+	// Flushes the current segment and queues its finalization.
+	void EndSegment()
+	{
+		fflush(m_file);
+
+		SegmentIndexHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = k_segmentIndexMagic;
+		header.version = k_segmentVersion;
+		header.entrySize = sizeof(SegmentIndexEntry);
+		header.cameraIndex = m_cameraIndex;
+		strncpy(header.serialNumber, m_serialNumber.c_str(), sizeof(header.serialNumber));
+		header.segmentIndex = m_segmentIndex;
+		header.frameCount = static_cast<uint32_t>(m_index.size());
+		header.segmentSize = m_segmentBytes;
+
+		std::shared_ptr<std::vector<SegmentIndexEntry> > index = std::make_shared<std::vector<SegmentIndexEntry> >();
+		index->swap(m_index);
+		m_index.reserve(index->size());
+
+		FILE * file = m_file;
+		std::string path = m_path;
+		std::string indexPath = SegmentIndexPath(m_fileBase, m_segmentIndex);
+		std::string command = m_finalizeCommand;
+		m_finalizer->Post([file, path, indexPath, command, header, index]() mutable
+		{
+			FinalizeSegment(file, path, indexPath, command, header, *index);
+		});
+
+		m_file = NULL;
+		m_segmentIndex++;
+		m_segments++;
+	}
+
+	// Runs on the finalizer thread: drops the unused preallocated space,
+	// checksums the segment and writes its index.
+	static void FinalizeSegment(FILE * file, const std::string & path, const std::string & indexPath, const std::string & command,
+		SegmentIndexHeader & header, const std::vector<SegmentIndexEntry> & index)
+	{
+		TruncateFile(file, header.segmentSize);
+		fclose(file);
+
+		std::vector<char> buffer(k_segmentBufferSize);
+		uint32_t checksum = 0;
+		FILE * segment = fopen(path.c_str(), "rb");
+		if (segment != NULL)
+		{
+			size_t n;
+			while ((n = fread(&buffer[0], 1, buffer.size(), segment)) > 0)
+			{
+				checksum = Crc32c(checksum, &buffer[0], n);
+			}
+			fclose(segment);
+		}
+		header.segmentChecksum = checksum;
+
+		FILE * indexFile = fopen(indexPath.c_str(), "wb");
+		if (indexFile != NULL)
+		{
+			fwrite(&header, sizeof(header), 1, indexFile);
+			if (!index.empty())
+			{
+				fwrite(&index[0], sizeof(SegmentIndexEntry), index.size(), indexFile);
+			}
+			fclose(indexFile);
+		}
+
+		if (!command.empty())
+		{
+			int status = RunFileCommand(command, path);
+			if (status != 0)
+			{
+				std::ostringstream message;
+				message << "Finalize command \"" << command << "\" failed on " << path << " (status " << status << ")..." << std::endl;
+				std::cout << message.str();
+			}
+		}
+	}
+
+	FILE * m_file;
+	std::string m_path;
+	std::shared_ptr<PreparedSegment> m_next;
+	SegmentFinalizer * m_finalizer;
+
+	std::string m_fileBase;
+	std::string m_serialNumber;
+	std::string m_finalizeCommand;
+	uint32_t m_cameraIndex;
+	uint64_t m_maxBytes;
+	int64_t m_maxDurationNs;
+
+	uint32_t m_segmentIndex;
+	uint64_t m_segmentBytes;
+	bool m_reserved;
+	int64_t m_openedAt;
+	std::vector<SegmentIndexEntry> m_index;
+
+	uint64_t m_totalBytes;
+	unsigned int m_segments;
+	unsigned int m_stalls;
+	unsigned int m_failures;
+};
+
+// Period between free space queries of the forecaster, and the weight of a
+// new rate sample in its moving average.
+const int64_t k_forecastPeriodNs = 5000000000LL;
+const double k_forecastRateWeight = 0.2;
+
+// This class forecasts how long the target disk lasts at the current write
+// rate. Update() is called with the total bytes written so far and the
+// preallocated bytes not written yet, and queries the free space at most
+// once per k_forecastPeriodNs. Frames are written into preallocated space,
+// which the disk already counts as used, so the reserved bytes count as
+// free; otherwise the free space would drop a whole segment at a time. The
+// forecast may be read from other threads.
+class DiskForecaster
+{
+public:
+	DiskForecaster() : m_lastBytes(0), m_lastTime(0), m_rate(0.0), m_freeBytes(0), m_valid(false) {}
+
+	void Reset(const std::string & filePrefix)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_filePrefix = filePrefix;
+		m_lastBytes = 0;
+		m_lastTime = 0;
+		m_rate = 0.0;
+		m_valid = false;
+	}
+
+	// Returns true when a new forecast is available.
+	bool Update(uint64_t bytesWritten, uint64_t bytesReserved)
+	{
+		int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		if (m_lastTime != 0 && now - m_lastTime < k_forecastPeriodNs)
+		{
+			return false;
+		}
+
+		// Reset() and Update() run on one thread, so the prefix and the last
+		// sample are read without the lock
+		uint64_t freeBytes = 0;
+		bool valid = m_lastTime != 0 && FreeDiskBytes(m_filePrefix, freeBytes);
+		freeBytes += bytesReserved;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_lastTime != 0)
+		{
+			double rate = (bytesWritten - m_lastBytes) * 1e9 / (now - m_lastTime);
+			m_rate = m_valid ? m_rate + k_forecastRateWeight * (rate - m_rate) : rate;
+			m_freeBytes = freeBytes;
+			m_valid = valid;
+		}
+		m_lastBytes = bytesWritten;
+		m_lastTime = now;
+		return m_valid;
+	}
+
+	// Seconds until the disk is full, negative if nothing is being written.
+	double SecondsLeft() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_valid && m_rate > 0.0 ? m_freeBytes / m_rate : -1.0;
+	}
+
+	double BytesPerSecond() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_rate;
+	}
+
+	uint64_t FreeBytes() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_freeBytes;
+	}
+
+private:
+	mutable std::mutex m_mutex;
+	std::string m_filePrefix;
+	uint64_t m_lastBytes;
+	int64_t m_lastTime;
+	double m_rate;
+	uint64_t m_freeBytes;
+	bool m_valid;
+};
+
+#endif // SEGMENT_WRITER_H
@@ -0,0 +1,110 @@
+//=============================================================================
+// SessionProtocol.h
+//
+// Protocol between the session coordinator (Coordinator.cpp) and the agents
+// that run next to the daemon of every capture host (Agent.cpp). It is the
+// line protocol of ControlSocket.h over TCP. Agents connect to the
+// coordinator and introduce themselves; the coordinator then sends commands
+// and the agents stream the metadata of their frames back:
+//
+//   agent:       {"type":"hello","host":"rig1","cameras":"16276718,16276719"}
+//   coordinator: {"cmd":"start","name":"run1","at":1700000000250000000}
+//   agent:       {"type":"started","ok":true}
+//   agent:       {"type":"frames","frames":"16276718 812 40 1700000000251002113;..."}
+//   coordinator: {"cmd":"stop","at":1700000010250000000}
+//   agent:       {"type":"stopped","frames":2000,"skipped":0,"untimed":0}
+//   coordinator: {"cmd":"shutdown"}
+//
+// Start and stop carry a host wall-clock time in ns since the epoch, a short
+// lead ahead of the coordinator's clock, so that all hosts act at the same
+// instant rather than whenever the command arrives. The host clocks are
+// expected to be disciplined by NTP or PTP. A session covers the frames whose
+// corrected timestamp (FrameMetadataRecord::hostTimestamp) lies between the
+// start and stop times. Agents pass both times on to their daemons, which
+// save exactly these frames. Frames without a corrected timestamp belong to
+// no session; agents count them as "untimed". Frames are sent in batches of
+// "serial frameId setSequence hostTimestamp" records separated by ';'.
+//=============================================================================
+
+#ifndef SESSION_PROTOCOL_H
+#define SESSION_PROTOCOL_H
+
+#include <stdint.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+const char * const k_defaultCoordinatorPort = "5560";
+
+// Lead of the start and stop times ahead of the coordinator's clock.
+const int64_t k_sessionLeadNs = 250000000;
+
+// Interval at which agents send the frames collected since the last batch.
+const int k_frameBatchMs = 100;
+
+// Size at which a batch is sent early, well below the line limit of
+// ControlSocket.h.
+const size_t k_maxFrameBatchBytes = 16384;
+
+// Time an agent keeps collecting after the stop time, for frames that are
+// still in flight between camera and frame bus.
+const int64_t k_sessionDrainNs = 500000000;
+
+// Metadata of one frame as exchanged between agent and coordinator.
+struct SessionFrame
+{
+	std::string serialNumber;
+	uint64_t frameId;
+	uint64_t setSequence;
+	int64_t hostTimestamp;
+};
+
+// Host wall-clock time in ns since the epoch, the clock hostTimestamp is
+// expressed in.
+inline int64_t WallClockNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline void AppendSessionFrame(std::string & batch, const SessionFrame & frame)
+{
+	char record[96];
+	snprintf(record, sizeof(record), " %llu %llu %lld;", static_cast<unsigned long long>(frame.frameId),
+		static_cast<unsigned long long>(frame.setSequence), static_cast<long long>(frame.hostTimestamp));
+	batch += frame.serialNumber;
+	batch += record;
+}
+
+// Parses a batch of frame records. Malformed records are dropped.
+inline void ParseSessionFrames(const std::string & batch, std::vector<SessionFrame> & frames)
+{
+	const char * pos = batch.c_str();
+	while (*pos != '\0')
+	{
+		const char * end = strchr(pos, ';');
+		if (end == NULL)
+		{
+			end = pos + strlen(pos);
+		}
+		const char * space = static_cast<const char *>(memchr(pos, ' ', end - pos));
+		if (space != NULL)
+		{
+			SessionFrame frame;
+			char * next = NULL;
+			frame.serialNumber.assign(pos, space);
+			frame.frameId = strtoull(space, &next, 10);
+			frame.setSequence = strtoull(next, &next, 10);
+			frame.hostTimestamp = strtoll(next, &next, 10);
+			if (next == end)
+			{
+				frames.push_back(frame);
+			}
+		}
+		pos = *end == ';' ? end + 1 : end;
+	}
+}
+
+#endif // SESSION_PROTOCOL_H
@@ -29,10 +29,34 @@
  *	camera for use with both a software and a hardware trigger. 
  */
 
+// ControlSocket.h pulls in winsock2.h, which must precede windows.h
+#include "ControlSocket.h"
+#include "FrameBus.h"
 #include "Spinnaker.h"
 #include "SpinGenApi/SpinnakerGenApi.h"
+#include "FrameMetadata.h"
+#include "ImageStats.h"
+#include "FramePipeline.h"
+#include "ChangeDetector.h"
+#include "SegmentWriter.h"
+#include "ReplayCamera.h"
 #include <iostream>
+#include <csignal>
 #include <sstream>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <memory>
+#include <deque>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 using namespace Spinnaker;
 using namespace Spinnaker::GenApi;
@@ -49,6 +73,21 @@ enum triggerType
 
 const triggerType chosenTrigger = SOFTWARE;
 
+// With a software trigger, every camera takes its own software trigger and is
+// fired together with the primary camera by the trigger fanout. Set 
+// k_softwareTriggerAllCameras to false to have the secondary cameras follow
+// the primary camera's Line2 output on their Line3 instead.
+const bool k_softwareTriggerAllCameras = true;
+
+// Cleared in daemon mode, where nothing may wait for console input; software
+// triggers are then fired through the control socket instead of the Enter key.
+bool interactiveMode = true;
+
+// Set in replay mode, where the cameras are ReplayCamera sources streaming a
+// recorded session instead of Spinnaker devices. Nothing is triggered or
+// configured; frames arrive with their recorded timing and metadata.
+bool replayMode = false;
+
 // This function configures the PRIMARY CAMERA. First the trigger mode
 // is turned off, then the LineSelector is switched to Line2 and 3.3V 
 // enabled. The Trigger mode remains off.
@@ -224,8 +263,9 @@ int ConfigureTrigger(INodeMap & nodeMap)
 
 			if (chosenTrigger == SOFTWARE)
 			{
-				// Set trigger mode to software
-				CEnumEntryPtr ptrTriggerSourceSoftware = ptrTriggerSource->GetEntryByName("Line3");
+				// Set trigger mode to software, or to the primary camera's
+				// output on 'Line3'
+				CEnumEntryPtr ptrTriggerSourceSoftware = ptrTriggerSource->GetEntryByName(k_softwareTriggerAllCameras ? "Software" : "Line3");
 				if (!IsAvailable(ptrTriggerSourceSoftware) || !IsReadable(ptrTriggerSourceSoftware))
 				{
 					cout << "Unable to set trigger mode (enum entry retrieval). Aborting..." << endl;
@@ -234,7 +274,7 @@ int ConfigureTrigger(INodeMap & nodeMap)
 
 				ptrTriggerSource->SetIntValue(ptrTriggerSourceSoftware->GetValue());
 
-				cout << "Trigger source set to software..." << endl;
+				cout << (k_softwareTriggerAllCameras ? "Trigger source set to software..." : "Trigger source set to Line3...") << endl;
 			}
 			else if (chosenTrigger == HARDWARE)
 			{
@@ -324,51 +364,111 @@ int ConfigureTrigger(INodeMap & nodeMap)
 }
 
 
-// This function retrieves a single image using the trigger. In this example, 
-// only a single image is captured and made available for acquisition - as such,
-// attempting to acquire two images for a single trigger execution would cause 
-// the example to hang. This is different from other examples, whereby a 
-// constant stream of images are being captured and made available for image
-// acquisition.
-int GrabNextImageByTrigger(INodeMap & nodeMap, CameraPtr pCam)
+// Chunk entries enabled on every camera. Each of them is appended by the
+// camera to the image payload, so the values travel with the frame and are
+// read back in AcquireImages() without touching the nodemap.
+const char * const k_chunkEntries[] = { "ExposureTime", "Gain", "Timestamp", "FrameID", "ExposureEndLineStatusAll" };
+const unsigned int k_numChunkEntries = sizeof(k_chunkEntries) / sizeof(k_chunkEntries[0]);
+
+// This function enables chunk data mode and selects the chunk entries listed
+// above. It must be called before acquisition starts.
+int ConfigureChunkData(INodeMap & nodeMap)
 {
 	int result = 0;
 
+	cout << endl << "*** CONFIGURING CHUNK DATA ***" << endl << endl;
+
 	try
 	{
-		// 
-		// Use trigger to capture image
+		//
+		// Activate chunk mode
 		//
 		// *** NOTES ***
-		// The software trigger only feigns being executed by the Enter key;
-		// what might not be immediately apparent is that there is not a
-		// continuous stream of images being captured; in other examples that 
-		// acquire images, the camera captures a continuous stream of images. 
-		// When an image is retrieved, it is plucked from the stream.
+		// Once chunk mode is active the ChunkSelector and ChunkEnable nodes 
+		// become writable; each entry is then selected and enabled in turn.
 		//
-		if (chosenTrigger == SOFTWARE)
+		CBooleanPtr ptrChunkModeActive = nodeMap.GetNode("ChunkModeActive");
+		if (!IsAvailable(ptrChunkModeActive) || !IsWritable(ptrChunkModeActive))
 		{
-			// Get user input
-			cout << "Press the Enter key to initiate software trigger." << endl;
-			getchar();
+			cout << "Unable to activate chunk mode. Aborting..." << endl;
+			return -1;
+		}
+		ptrChunkModeActive->SetValue(true);
+		cout << "Chunk mode activated..." << endl;
+
+		CEnumerationPtr ptrChunkSelector = nodeMap.GetNode("ChunkSelector");
+		if (!IsAvailable(ptrChunkSelector) || !IsReadable(ptrChunkSelector))
+		{
+			cout << "Unable to retrieve chunk selector. Aborting..." << endl;
+			return -1;
+		}
+
+		for (unsigned int i = 0; i < k_numChunkEntries; i++)
+		{
+			CEnumEntryPtr ptrChunkSelectorEntry = ptrChunkSelector->GetEntryByName(k_chunkEntries[i]);
+			if (!IsAvailable(ptrChunkSelectorEntry) || !IsReadable(ptrChunkSelectorEntry))
+			{
+				cout << "Unable to select chunk entry " << k_chunkEntries[i] << ". Aborting..." << endl;
+				return -1;
+			}
+			ptrChunkSelector->SetIntValue(ptrChunkSelectorEntry->GetValue());
 
-			// Execute software trigger
-			CCommandPtr ptrSoftwareTriggerCommand = nodeMap.GetNode("TriggerSoftware");
-			if (!IsAvailable(ptrSoftwareTriggerCommand) || !IsWritable(ptrSoftwareTriggerCommand))
+			CBooleanPtr ptrChunkEnable = nodeMap.GetNode("ChunkEnable");
+			if (!IsAvailable(ptrChunkEnable) || !IsWritable(ptrChunkEnable))
 			{
-				cout << "CHECKKKKK Unable to execute trigger. Aborting..." << endl;
+				cout << "Unable to enable chunk entry " << k_chunkEntries[i] << ". Aborting..." << endl;
 				return -1;
 			}
+			ptrChunkEnable->SetValue(true);
+			cout << "Chunk entry " << k_chunkEntries[i] << " enabled..." << endl;
+		}
+		cout << endl;
+	}
+	catch (Spinnaker::Exception &e)
+	{
+		cout << "Error: " << e.what() << endl;
+		result = -1;
+	}
+
+	return result;
+}
 
-			ptrSoftwareTriggerCommand->Execute();
+// This function disables the chunk entries and deactivates chunk mode to 
+// restore the camera to a clean state.
+int DisableChunkData(INodeMap & nodeMap)
+{
+	int result = 0;
 
-			// TODO: Blackfly and Flea3 GEV cameras need 2 second delay after software trigger 
+	try
+	{
+		CEnumerationPtr ptrChunkSelector = nodeMap.GetNode("ChunkSelector");
+		CBooleanPtr ptrChunkEnable = nodeMap.GetNode("ChunkEnable");
+		if (IsAvailable(ptrChunkSelector) && IsReadable(ptrChunkSelector))
+		{
+			for (unsigned int i = 0; i < k_numChunkEntries; i++)
+			{
+				CEnumEntryPtr ptrChunkSelectorEntry = ptrChunkSelector->GetEntryByName(k_chunkEntries[i]);
+				if (!IsAvailable(ptrChunkSelectorEntry) || !IsReadable(ptrChunkSelectorEntry))
+				{
+					continue;
+				}
+				ptrChunkSelector->SetIntValue(ptrChunkSelectorEntry->GetValue());
+				if (IsAvailable(ptrChunkEnable) && IsWritable(ptrChunkEnable))
+				{
+					ptrChunkEnable->SetValue(false);
+				}
+			}
 		}
-		else if (chosenTrigger == HARDWARE)
+
+		CBooleanPtr ptrChunkModeActive = nodeMap.GetNode("ChunkModeActive");
+		if (!IsAvailable(ptrChunkModeActive) || !IsWritable(ptrChunkModeActive))
 		{
-			// Execute hardware trigger
-			cout << "Use the hardware to trigger image acquisition." << endl;
+			cout << "Unable to deactivate chunk mode. Non-fatal error..." << endl;
+			return -1;
 		}
+		ptrChunkModeActive->SetValue(false);
+
+		cout << "Chunk mode deactivated..." << endl;
 	}
 	catch (Spinnaker::Exception &e)
 	{
@@ -379,6 +479,64 @@ int GrabNextImageByTrigger(INodeMap & nodeMap, CameraPtr pCam)
 	return result;
 }
 
+// This function opens the per-frame metadata stream of a camera and writes 
+// its header. The stream is fully buffered so that appending a record in the
+// grab loop is a plain memory copy; see FrameMetadata.h for the layout.
+FILE * OpenFrameMetadata(const string & fileBase, const gcstring & serialNumber, unsigned int camIndex)
+{
+	ostringstream filename;
+	filename << fileBase << ".meta";
+
+	FILE * metadataFile = fopen(filename.str().c_str(), "wb");
+	if (metadataFile == NULL)
+	{
+		cout << "Unable to open metadata file " << filename.str() << "..." << endl;
+		return NULL;
+	}
+	setvbuf(metadataFile, NULL, _IOFBF, 1 << 16);
+
+	FrameMetadataHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = k_frameMetadataMagic;
+	header.version = k_frameMetadataVersion;
+	header.recordSize = sizeof(FrameMetadataRecord);
+	header.cameraIndex = camIndex;
+	strncpy(header.serialNumber, serialNumber.c_str(), sizeof(header.serialNumber));
+	fwrite(&header, sizeof(header), 1, metadataFile);
+
+	cout << "Camera " << camIndex << " metadata saved at " << filename.str() << endl;
+
+	return metadataFile;
+}
+
+// This function fills a metadata record from the chunk data of a grabbed
+// image. ChunkData is parsed by Spinnaker from the image buffer itself, so no
+// node access or copy of the payload is involved. The host timestamp is left
+// for the caller, which owns the camera clock.
+void ReadFrameMetadata(FrameMetadataRecord & record, const ImagePtr & pImage, unsigned int imageCnt)
+{
+	const ChunkData & chunkData = pImage->GetChunkData();
+
+	record.frameId = static_cast<uint64_t>(chunkData.GetFrameID());
+	record.timestamp = static_cast<uint64_t>(chunkData.GetTimestamp());
+	record.exposureTime = chunkData.GetExposureTime();
+	record.gain = chunkData.GetGain();
+	record.lineStatusAll = static_cast<uint32_t>(chunkData.GetExposureEndLineStatusAll());
+	record.imageCnt = imageCnt;
+	record.hostTimestamp = 0;
+}
+
+// This function appends a metadata record to the metadata stream.
+void WriteFrameMetadata(FILE * metadataFile, const FrameMetadataRecord & record)
+{
+	if (metadataFile == NULL)
+	{
+		return;
+	}
+
+	fwrite(&record, sizeof(record), 1, metadataFile);
+}
+
 // This function returns the camera to a normal state by turning off trigger 
 // mode.
 int ResetTrigger(INodeMap & nodeMap)
@@ -496,193 +654,2321 @@ int PrintDeviceInfo(INodeMap & nodeMap, unsigned int camNum)
 //	return result;
 //}
 
-// This function acquires and saves 10 images from each device.  
-int AcquireImages(CameraList camList)
+// Number of latch samples kept per camera for the clock fit. With the default
+// sync period this covers the last half minute.
+const unsigned int k_clockWindow = 32;
+
+// This class maps the free-running timestamp counter of one camera to the
+// monotonic host clock. It keeps a sliding window of (camera, host) pairs 
+// from TimestampLatch and fits host = offset + drift * camera by least 
+// squares. Samples are added by the clock sync thread; conversions happen in
+// the grab path.
+class CameraClock
 {
-	int result = 0;
-	CameraPtr pCam = NULL;
+public:
+	CameraClock() : m_valid(false), m_cameraBase(0), m_hostBase(0), m_offset(0.0), m_drift(1.0), m_residual(0.0) {}
 
-	cout << endl << "*** IMAGE ACQUISITION ***" << endl << endl;
+	// Drops all samples; the counter of a re-initialized camera restarts.
+	void Reset()
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_samples.clear();
+		m_valid = false;
+	}
 
-	try
+	void AddSample(int64_t cameraNs, int64_t hostNs)
 	{
-		//
-		// Prepare each camera to acquire images
-		// 
-		// *** NOTES ***
-		// For pseudo-simultaneous streaming, each camera is prepared as if it 
-		// were just one, but in a loop. Notice that cameras are selected with 
-		// an index. We demonstrate pseduo-simultaneous streaming because true 
-		// simultaneous streaming would require multiple process or threads,
-		// which is too complex for an example. 
-		// 
-		// Serial numbers are the only persistent objects we gather in this
-		// example, which is why a vector is created.
-		//
-		vector<gcstring> strSerialNumbers(camList.GetSize());
+		lock_guard<mutex> lock(m_mutex);
+		m_samples.push_back(make_pair(cameraNs, hostNs));
+		if (m_samples.size() > k_clockWindow)
+		{
+			m_samples.pop_front();
+		}
+		Fit();
+	}
 
-		for (int i = 0; i < camList.GetSize(); i++)
+	// Converts a camera timestamp to host monotonic ns. Returns false until 
+	// the first sample has been taken.
+	bool ToHostTime(int64_t cameraNs, int64_t & hostNs) const
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (!m_valid)
 		{
-			// Select camera
-			pCam = camList.GetByIndex(i);
+			return false;
+		}
+		hostNs = m_hostBase + static_cast<int64_t>(m_offset + m_drift * static_cast<double>(cameraNs - m_cameraBase));
+		return true;
+	}
 
-			// Set acquisition mode to continuous
-			CEnumerationPtr ptrAcquisitionMode = pCam->GetNodeMap().GetNode("AcquisitionMode");
-			if (!IsAvailable(ptrAcquisitionMode) || !IsWritable(ptrAcquisitionMode))
-			{
-				cout << "Unable to set acquisition mode to continuous (node retrieval; camera " << i << "). Aborting..." << endl << endl;
-				return -1;
-			}
-			CEnumEntryPtr ptrAcquisitionModeContinuous = ptrAcquisitionMode->GetEntryByName("Continuous");
-			if (!IsAvailable(ptrAcquisitionModeContinuous) || !IsReadable(ptrAcquisitionModeContinuous))
-			{
-				cout << "Unable to set acquisition mode to continuous (entry 'continuous' retrieval " << i << "). Aborting..." << endl << endl;
-				return -1;
-			}
-			int64_t acquisitionModeContinuous = ptrAcquisitionModeContinuous->GetValue();
-			ptrAcquisitionMode->SetIntValue(acquisitionModeContinuous);
-			cout << "Camera " << i << " acquisition mode set to continuous..." << endl;
+	void GetFit(double & driftPpm, double & residualUs, unsigned int & samples) const
+	{
+		lock_guard<mutex> lock(m_mutex);
+		driftPpm = (m_drift - 1.0) * 1e6;
+		residualUs = m_residual / 1000.0;
+		samples = static_cast<unsigned int>(m_samples.size());
+	}
 
-			// Begin acquiring images
-			pCam->BeginAcquisition();
-			cout << "Camera " << i << " started acquiring images..." << endl;
+private:
+	// Fits relative to the oldest sample so that the doubles only hold the
+	// span of the window, not absolute nanosecond counts.
+	void Fit()
+	{
+		m_cameraBase = m_samples.front().first;
+		m_hostBase = m_samples.front().second;
 
-			// Retrieve device serial number for filename
-			strSerialNumbers[i] = "";
-			CStringPtr ptrStringSerial = pCam->GetTLDeviceNodeMap().GetNode("DeviceSerialNumber");
-			if (IsAvailable(ptrStringSerial) && IsReadable(ptrStringSerial))
-			{
-				strSerialNumbers[i] = ptrStringSerial->GetValue();
-				cout << "Camera " << i << " serial number set to " << strSerialNumbers[i] << "..." << endl;
-			}
-			cout << endl;
+		const double n = static_cast<double>(m_samples.size());
+		double meanX = 0.0;
+		double meanY = 0.0;
+		for (size_t i = 0; i < m_samples.size(); i++)
+		{
+			meanX += static_cast<double>(m_samples[i].first - m_cameraBase);
+			meanY += static_cast<double>(m_samples[i].second - m_hostBase);
 		}
+		meanX /= n;
+		meanY /= n;
 
-		//
-		// Retrieve, convert, and save images for each camera
-		//
-		// *** NOTES ***
-		// In order to work with simultaneous camera streams, nested loops are
-		// needed. It is important that the inner loop be the one iterating
-		// through the cameras; otherwise, all images will be grabbed from a
-		// single camera before grabbing any images from another.
-		//
-		const unsigned int k_numImages = 10;
+		double sxx = 0.0;
+		double sxy = 0.0;
+		for (size_t i = 0; i < m_samples.size(); i++)
+		{
+			double dx = static_cast<double>(m_samples[i].first - m_cameraBase) - meanX;
+			double dy = static_cast<double>(m_samples[i].second - m_hostBase) - meanY;
+			sxx += dx * dx;
+			sxy += dx * dy;
+		}
+		m_drift = sxx > 0.0 ? sxy / sxx : 1.0;
+		m_offset = meanY - m_drift * meanX;
 
-		for (unsigned int imageCnt = 0; imageCnt < k_numImages; imageCnt++)
+		double sumSquares = 0.0;
+		for (size_t i = 0; i < m_samples.size(); i++)
 		{
-			for (int i = 0; i < camList.GetSize(); i++)
-			{
-				try
-				{
-					// Select camera
-					pCam = camList.GetByIndex(i);
+			double residual = static_cast<double>(m_samples[i].second - m_hostBase)
+				- (m_offset + m_drift * static_cast<double>(m_samples[i].first - m_cameraBase));
+			sumSquares += residual * residual;
+		}
+		m_residual = sqrt(sumSquares / n);
+		m_valid = true;
+	}
+
+	mutable mutex m_mutex;
+	deque<pair<int64_t, int64_t> > m_samples;
+	bool m_valid;
+	int64_t m_cameraBase;
+	int64_t m_hostBase;
+	double m_offset;
+	double m_drift;
+	double m_residual;
+};
 
-					// Retrieve TL device nodemap
-					INodeMap & nodeMap = pCam->GetTLDeviceNodeMap();
+// Per-camera state of the acquisition loop. A camera leaves the streaming
+// state when it drops off the bus and returns to it once its recovery 
+// thread has re-initialized it; the acquisition loop only touches pCam while
+// the camera is streaming.
+enum cameraState
+{
+	CAMERA_STREAMING,
+	CAMERA_RECOVERING,
+	CAMERA_LOST
+};
 
-					// Retrieve the next image from the trigger
-					result = result | GrabNextImageByTrigger(nodeMap, pCam);
+struct CameraSlot
+{
+	CameraPtr pCam;
+	gcstring serialNumber;
+	unsigned int index;
+	FILE * metadataFile;
+
+	// Configuration cached after ConfigureTrigger() so that a recovered
+	// camera comes back with the same settings
+	double exposureTime;
+	double gain;
+
+	atomic<int> state;
+	thread recoveryThread;
+	chrono::steady_clock::time_point removedAt;
+
+	// Counters, read by the daemon control thread for statistics
+	atomic<unsigned int> grabbedImages;
+	atomic<unsigned int> incompleteImages;
+	atomic<unsigned int> savedImages;
+	atomic<unsigned int> missedImages;
+
+	// Trigger handle, set by TriggerFanout::Attach()
+	bool softwareTriggered;
+	CCommandPtr ptrTriggerSoftware;
+
+	// Mapping of the camera timestamps to host time
+	CameraClock clock;
+
+	// Shared-memory ring publishing the live frames
+	FrameBusWriter frameBus;
+
+	// Exposure handles and statistics of the last complete image, for the
+	// auto-exposure controller
+	CFloatPtr ptrExposureTime;
+	CFloatPtr ptrGain;
+	ImageStats stats;
+	bool statsValid;
+
+	// Change detector of the motion gate
+	ChangeDetector changeDetector;
+
+	// Segments of the current recording session
+	SegmentWriter recorder;
+
+	// Recorded source of the slot in replay mode, NULL for a live camera
+	ReplayCamera * replay;
+
+	// Processing chain specialized on the pixel format of the session
+	unique_ptr<FrameProcessor> pipeline;
+
+	// Guards pCam against threads other than the acquisition loop while a
+	// recovery thread replaces it
+	mutex handleMutex;
+};
 
-					// Retrieve next received image and ensure image completion
-					ImagePtr pResultImage = pCam->GetNextImage();
+// Timeout of a single GetNextImage() call. A timeout only ends the wait when
+// the camera has been removed; live cameras are simply waited on again.
+const uint64_t k_grabTimeoutMs = 1000;
 
-					if (pResultImage->IsIncomplete())
-					{
-						cout << "Image incomplete with image status " << pResultImage->GetImageStatus() << "..." << endl << endl;
-					}
-					else
-					{
-						// Print image information
-						cout << "Camera " << i << " grabbed image " << imageCnt << ", width = " << pResultImage->GetWidth() << ", height = " << pResultImage->GetHeight() << endl;
-
-						// Convert image to mono 8
-						ImagePtr convertedImage = pResultImage->Convert(PixelFormat_Mono8, HQ_LINEAR);
-
-						// Create a unique filename
-						ostringstream filename;
-						filename << "AcquisitionMultipleCamera-";
-						if (strSerialNumbers[i] != "")
-						{
-							filename << strSerialNumbers[i].c_str();
-						}
-						else
-						{
-							filename << i;
-						}
-						filename << "-" << imageCnt << ".jpg";
-
-						// Save image
-						convertedImage->Save(filename.str().c_str());
-						cout << "Image saved at " << filename.str() << endl;
-					}
+// Raised by the daemon control thread to make a blocked acquisition loop
+// return between synchronized sets; see GetNextImageOrRemoval().
+atomic<bool> grabInterrupted(false);
 
-					// Release image
-					pResultImage->Release();
-					cout << endl;
-				}
-				catch (Spinnaker::Exception &e)
-				{
-					cout << "Error: " << e.what() << endl;
-					result = -1;
-				}
+// How long a recovery thread waits for a removed camera to reappear.
+const unsigned int k_recoveryTimeoutMs = 30000;
+
+// Set k_simulatedDisconnectCamera to a camera index to make the acquisition
+// loop report that camera as removed (and immediately re-arrived) at image
+// k_simulatedDisconnectImage. This exercises the complete recovery path 
+// without unplugging anything.
+const int k_simulatedDisconnectCamera = -1;
+const unsigned int k_simulatedDisconnectImage = 5;
+
+// This class receives device arrival and removal events from the system and
+// tracks recovery metrics. Events arrive on a Spinnaker thread; the 
+// acquisition loop and the recovery threads query the state under a lock.
+class DeviceEventHandler : public InterfaceEvent
+{
+public:
+	DeviceEventHandler() : m_shutdown(false), m_disconnects(0), m_failedRecoveries(0) {}
+	~DeviceEventHandler() {}
+
+	void OnDeviceArrival(uint64_t deviceSerialNumber)
+	{
+		InjectArrival(SerialToString(deviceSerialNumber));
+	}
+
+	void OnDeviceRemoval(uint64_t deviceSerialNumber)
+	{
+		InjectRemoval(SerialToString(deviceSerialNumber));
+	}
+
+	void InjectArrival(const string & serialNumber)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		cout << "Device " << serialNumber << " arrived..." << endl;
+		m_removed.erase(serialNumber);
+		m_arrived.insert(serialNumber);
+		m_arrival.notify_all();
+	}
+
+	void InjectRemoval(const string & serialNumber)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		cout << "Device " << serialNumber << " removed..." << endl;
+		m_arrived.erase(serialNumber);
+		m_removed.insert(serialNumber);
+	}
+
+	bool IsRemoved(const string & serialNumber)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		return m_removed.count(serialNumber) != 0;
+	}
+
+	// Blocks until the device arrives again, the timeout expires or the 
+	// handler is shut down. Returns true if the device is back.
+	bool WaitForArrival(const string & serialNumber, unsigned int timeoutMs)
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_arrival.wait_for(lock, chrono::milliseconds(timeoutMs), [&]
+		{
+			return m_shutdown || m_arrived.count(serialNumber) != 0;
+		});
+		bool arrived = !m_shutdown && m_arrived.count(serialNumber) != 0;
+		m_arrived.erase(serialNumber);
+		return arrived;
+	}
+
+	// Wakes all recovery threads so that they can be joined.
+	void Shutdown()
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_shutdown = true;
+		m_arrival.notify_all();
+	}
+
+	void Restart()
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_shutdown = false;
+	}
+
+	void RecordDisconnect()
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_disconnects++;
+	}
+
+	void RecordRecovery(double recoveryTimeMs, bool recovered)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (recovered)
+		{
+			m_recoveryTimesMs.push_back(recoveryTimeMs);
+		}
+		else
+		{
+			m_failedRecoveries++;
+		}
+	}
+
+	void PrintRecoveryStats()
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (m_disconnects == 0)
+		{
+			return;
+		}
+
+		cout << endl << "*** CAMERA RECOVERY ***" << endl << endl;
+		cout << "Disconnects: " << m_disconnects << ", recovered: " << m_recoveryTimesMs.size() << ", failed: " << m_failedRecoveries << endl;
+		if (!m_recoveryTimesMs.empty())
+		{
+			double sum = 0.0;
+			for (size_t i = 0; i < m_recoveryTimesMs.size(); i++)
+			{
+				sum += m_recoveryTimesMs[i];
 			}
+			cout << "Recovery time min/mean/max: " << *min_element(m_recoveryTimesMs.begin(), m_recoveryTimesMs.end()) << " / "
+				<< sum / m_recoveryTimesMs.size() << " / " << *max_element(m_recoveryTimesMs.begin(), m_recoveryTimesMs.end()) << " ms" << endl;
 		}
+		cout << endl;
+	}
 
-		//
-		// End acquisition for each camera
-		//
-		// *** NOTES ***
-		// Notice that what is usually a one-step process is now two steps
-		// because of the additional step of selecting the camera. It is worth
-		// repeating that camera selection needs to be done once per loop.
-		//
-		// It is possible to interact with cameras through the camera list with
-		// GetByIndex(); this is an alternative to retrieving cameras as 
-		// CameraPtr objects that can be quick and easy for small tasks.
-		//
-		for (int i = 0; i < camList.GetSize(); i++)
+private:
+	static string SerialToString(uint64_t deviceSerialNumber)
+	{
+		ostringstream serial;
+		serial << deviceSerialNumber;
+		return serial.str();
+	}
+
+	mutex m_mutex;
+	condition_variable m_arrival;
+	set<string> m_arrived;
+	set<string> m_removed;
+	bool m_shutdown;
+	unsigned int m_disconnects;
+	unsigned int m_failedRecoveries;
+	vector<double> m_recoveryTimesMs;
+};
+
+DeviceEventHandler deviceEventHandler;
+
+// Period of the clock sync thread, and the longest latch round trip that is
+// still accepted as a sample. A slow round trip leaves the moment of the
+// latch too uncertain to be useful.
+const unsigned int k_clockSyncPeriodMs = 1000;
+const int64_t k_maxLatchRoundTripNs = 2000000;
+
+// This class runs the clock sync thread. It periodically latches the 
+// timestamp of every streaming camera and feeds the sample to the camera's
+// CameraClock. It also tracks the offset between the monotonic host clock 
+// and wall-clock time, so that frames can be stamped with a host time that 
+// is comparable across machines.
+class ClockSync
+{
+public:
+	ClockSync() : m_stop(false), m_wallOffsetNs(0), m_rejectedSamples(0) {}
+	~ClockSync() { Stop(); }
+
+	void Start(vector<CameraSlot> & cameras)
+	{
+		UpdateWallOffset();
+		m_stop = false;
+		m_thread = thread(&ClockSync::Run, this, &cameras);
+	}
+
+	void Stop()
+	{
 		{
-			// End acquisition
-			camList.GetByIndex(i)->EndAcquisition();
+			lock_guard<mutex> lock(m_mutex);
+			m_stop = true;
+			m_wake.notify_all();
+		}
+		if (m_thread.joinable())
+		{
+			m_thread.join();
 		}
 	}
-	catch (Spinnaker::Exception &e)
+
+	// Restarts the clock of a camera with a fresh sample. Called when 
+	// streaming starts and again after a camera is recovered.
+	void Attach(CameraSlot & slot)
 	{
-		cout << "Error: " << e.what() << endl;
-		result = -1;
+		slot.clock.Reset();
+		Sample(slot.pCam, slot.clock);
 	}
 
-	return result;
-}
+	// Converts a camera timestamp to host wall-clock ns since the epoch.
+	// Returns 0 if the camera clock has no sample yet.
+	int64_t ToWallTime(const CameraClock & clock, int64_t cameraNs) const
+	{
+		int64_t hostNs = 0;
+		if (!clock.ToHostTime(cameraNs, hostNs))
+		{
+			return 0;
+		}
+		return hostNs + m_wallOffsetNs.load();
+	}
 
+	void PrintClockStats(const vector<CameraSlot> & cameras)
+	{
+		cout << endl << "*** CAMERA CLOCKS ***" << endl << endl;
+		for (unsigned int i = 0; i < cameras.size(); i++)
+		{
+			double driftPpm = 0.0;
+			double residualUs = 0.0;
+			unsigned int samples = 0;
+			cameras[i].clock.GetFit(driftPpm, residualUs, samples);
+			cout << "Camera " << i << " drift " << driftPpm << " ppm, fit residual " << residualUs << " us over " << samples << " samples" << endl;
+		}
+		if (m_rejectedSamples.load() > 0)
+		{
+			cout << "Rejected " << m_rejectedSamples.load() << " slow latch samples" << endl;
+		}
+		cout << endl;
+	}
 
+	static int64_t HostNow()
+	{
+		return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	}
 
+	// Host wall-clock time in ns since the epoch, the clock of hostTimestamp.
+	static int64_t WallNow()
+	{
+		return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+	}
 
-// This function acquires and saves 10 images from a device; please see
-// Acquisition example for more in-depth comments on acquiring images.
-//int AcquireImages(CameraPtr pCam, INodeMap & nodeMap, INodeMap & nodeMapTLDevice)
-//{
-//	int result = 0;
-//
-//	cout << endl << "*** IMAGE ACQUISITION ***" << endl << endl;
-//
-//	try
-//	{
-//		// Set acquisition mode to continuous
-//		CEnumerationPtr ptrAcquisitionMode = nodeMap.GetNode("AcquisitionMode");
-//		if (!IsAvailable(ptrAcquisitionMode) || !IsWritable(ptrAcquisitionMode))
-//		{
-//			cout << "Unable to set acquisition mode to continuous (node retrieval). Aborting..." << endl << endl;
-//			return -1;
-//		}
-//		CEnumEntryPtr ptrAcquisitionModeContinuous = ptrAcquisitionMode->GetEntryByName("Continuous");
-//		if (!IsAvailable(ptrAcquisitionModeContinuous) || !IsReadable(ptrAcquisitionModeContinuous))
-//		{
-//			cout << "Unable to set acquisition mode to continuous (entry 'continuous' retrieval). Aborting..." << endl << endl;
-//			return -1;
-//		}
-//		int64_t acquisitionModeContinuous = ptrAcquisitionModeContinuous->GetValue();
+private:
+	void Run(vector<CameraSlot> * cameras)
+	{
+		unique_lock<mutex> lock(m_mutex);
+		while (!m_wake.wait_for(lock, chrono::milliseconds(k_clockSyncPeriodMs), [&] { return m_stop; }))
+		{
+			lock.unlock();
+			UpdateWallOffset();
+			for (unsigned int i = 0; i < cameras->size(); i++)
+			{
+				CameraSlot & slot = (*cameras)[i];
+
+				// Take a reference under the handle lock; a recovery thread may
+				// be replacing the camera
+				CameraPtr pCam;
+				{
+					lock_guard<mutex> handleLock(slot.handleMutex);
+					if (slot.state.load() != CAMERA_STREAMING)
+					{
+						continue;
+					}
+					pCam = slot.pCam;
+				}
+				Sample(pCam, slot.clock);
+			}
+			lock.lock();
+		}
+	}
+
+	// Latches the camera timestamp between two host clock readings and takes
+	// the midpoint as the host time of the latch.
+	void Sample(CameraPtr pCam, CameraClock & clock)
+	{
+		try
+		{
+			INodeMap & nodeMap = pCam->GetNodeMap();
+			CCommandPtr ptrTimestampLatch = nodeMap.GetNode("TimestampLatch");
+			CIntegerPtr ptrTimestampLatchValue = nodeMap.GetNode("TimestampLatchValue");
+			if (!IsAvailable(ptrTimestampLatch) || !IsWritable(ptrTimestampLatch) || !IsAvailable(ptrTimestampLatchValue) || !IsReadable(ptrTimestampLatchValue))
+			{
+				return;
+			}
+
+			int64_t before = HostNow();
+			ptrTimestampLatch->Execute();
+			int64_t after = HostNow();
+			if (after - before > k_maxLatchRoundTripNs)
+			{
+				m_rejectedSamples++;
+				return;
+			}
+
+			clock.AddSample(ptrTimestampLatchValue->GetValue(), before + (after - before) / 2);
+		}
+		catch (Spinnaker::Exception &e)
+		{
+			cout << "Error: " << e.what() << endl;
+		}
+	}
+
+	void UpdateWallOffset()
+	{
+		int64_t wallNs = WallNow();
+		m_wallOffsetNs.store(wallNs - HostNow());
+	}
+
+	thread m_thread;
+	mutex m_mutex;
+	condition_variable m_wake;
+	bool m_stop;
+	atomic<int64_t> m_wallOffsetNs;
+	atomic<unsigned int> m_rejectedSamples;
+};
+
+ClockSync clockSync;
+
+// Keys of the GigE action command used to trigger all GigE cameras with a 
+// single broadcast packet. Set k_useActionCommands to false to always use the
+// threaded software trigger fanout.
+const bool k_useActionCommands = true;
+const int64_t k_actionDeviceKey = 0x12345678;
+const int64_t k_actionGroupKey = 0x1;
+const int64_t k_actionGroupMask = 0x1;
+
+// This class fires the software trigger of all software-triggered cameras at
+// once. ConfigureTrigger() sets every camera to the software trigger unless
+// k_softwareTriggerAllCameras is cleared, in which case only the primary
+// camera is fired and the others follow it in hardware. Trigger commands are resolved once per camera in Attach(), so firing 
+// involves no node lookups. If every such camera is a GigE camera that
+// supports action commands, a single action command broadcast triggers them
+// all; otherwise one worker thread per camera executes its TriggerSoftware 
+// command as soon as Fire() releases them together. The trigger source is
+// switched to the action command in Configure(), before streaming starts,
+// since many cameras lock TriggerSource while streaming; a camera that does
+// not take the switch keeps its software trigger, which Fire() executes right
+// after the broadcast.
+//
+// The achieved inter-camera skew of every synchronized set is measured from
+// the chunk timestamps of its images, mapped to host time by the camera
+// clocks.
+class TriggerFanout
+{
+public:
+	TriggerFanout() : m_cameras(NULL), m_useActionCommand(false), m_stop(false), m_generation(0), m_pending(0), m_result(0),
+		m_skewSets(0), m_skewSumNs(0.0), m_skewMaxNs(0), m_fireSumUs(0.0), m_fireMaxUs(0.0), m_fires(0) {}
+	~TriggerFanout() { Stop(); }
+
+	// Decides between action commands and worker threads and starts the 
+	// workers. Cameras are attached afterwards.
+	void Start(SystemPtr system, vector<CameraSlot> & cameras)
+	{
+		m_cameras = &cameras;
+		m_useActionCommand = false;
+		if (chosenTrigger == SOFTWARE && k_useActionCommands && SupportsActionCommands(system, cameras))
+		{
+			m_useActionCommand = ConfigureActionCommand(system);
+		}
+
+		if (chosenTrigger == SOFTWARE && !m_useActionCommand)
+		{
+			m_stop = false;
+			for (unsigned int i = 0; i < cameras.size(); i++)
+			{
+				m_workers.push_back(thread(&TriggerFanout::RunWorker, this, &cameras[i]));
+			}
+		}
+
+		if (chosenTrigger == SOFTWARE)
+		{
+			cout << "Software trigger fanout uses " << (m_useActionCommand ? "GigE action commands" : "one thread per camera") << "..." << endl;
+		}
+	}
+
+	void Stop()
+	{
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_stop = true;
+			m_go.notify_all();
+		}
+		for (size_t i = 0; i < m_workers.size(); i++)
+		{
+			m_workers[i].join();
+		}
+		m_workers.clear();
+	}
+
+	// Switches a software-triggered camera to the action command. Must be
+	// called before the camera starts streaming.
+	void Configure(CameraPtr pCam, unsigned int camIndex)
+	{
+		if (!m_useActionCommand)
+		{
+			return;
+		}
+		INodeMap & nodeMap = pCam->GetNodeMap();
+		CEnumerationPtr ptrTriggerSource = nodeMap.GetNode("TriggerSource");
+		if (IsAvailable(ptrTriggerSource) && IsReadable(ptrTriggerSource) && ptrTriggerSource->GetCurrentEntry()->GetSymbolic() == "Software"
+			&& !ConfigureActionTrigger(nodeMap))
+		{
+			cout << "Camera " << camIndex << " cannot switch to the action command; using its software trigger..." << endl;
+		}
+	}
+
+	// Resolves the trigger handle of a camera.
+	// Called when streaming starts and again after a camera is recovered.
+	void Attach(CameraSlot & slot)
+	{
+		INodeMap & nodeMap = slot.pCam->GetNodeMap();
+
+		slot.softwareTriggered = false;
+		slot.ptrTriggerSoftware = CCommandPtr();
+
+		CEnumerationPtr ptrTriggerSource = nodeMap.GetNode("TriggerSource");
+		if (chosenTrigger != SOFTWARE || !IsAvailable(ptrTriggerSource) || !IsReadable(ptrTriggerSource))
+		{
+			return;
+		}
+		gcstring source = ptrTriggerSource->GetCurrentEntry()->GetSymbolic();
+		if (source == "Software")
+		{
+			slot.softwareTriggered = true;
+			slot.ptrTriggerSoftware = nodeMap.GetNode("TriggerSoftware");
+		}
+		else if (source == "Action0" && m_useActionCommand)
+		{
+			slot.softwareTriggered = true;
+		}
+	}
+
+	// Fires the trigger of all software-triggered cameras and returns once 
+	// every command has been issued.
+	int Fire()
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		int result = 0;
+
+		if (m_useActionCommand)
+		{
+			try
+			{
+				m_ptrActionCommand->Execute();
+
+				// Cameras that did not take the action trigger source
+				for (size_t i = 0; i < m_cameras->size(); i++)
+				{
+					CameraSlot & slot = (*m_cameras)[i];
+					if (slot.state.load() == CAMERA_STREAMING && slot.softwareTriggered && IsAvailable(slot.ptrTriggerSoftware))
+					{
+						slot.ptrTriggerSoftware->Execute();
+					}
+				}
+			}
+			catch (Spinnaker::Exception &e)
+			{
+				cout << "Error: " << e.what() << endl;
+				result = -1;
+			}
+		}
+		else
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_result = 0;
+			m_pending = static_cast<unsigned int>(m_workers.size());
+			m_generation++;
+			m_go.notify_all();
+			m_done.wait(lock, [&] { return m_pending == 0; });
+			result = m_result;
+		}
+
+		double fireUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+		lock_guard<mutex> lock(m_statsMutex);
+		m_fires++;
+		m_fireSumUs += fireUs;
+		m_fireMaxUs = max(m_fireMaxUs, fireUs);
+
+		return result;
+	}
+
+	// Records the skew of one synchronized set from the chunk timestamps of
+	// its images; cameras without an image in the set are passed as -1.
+	void RecordSet(const vector<CameraSlot> & cameras, const vector<int64_t> & timestamps)
+	{
+		int64_t first = 0;
+		int64_t last = 0;
+		unsigned int count = 0;
+		for (unsigned int i = 0; i < cameras.size(); i++)
+		{
+			if (timestamps[i] < 0)
+			{
+				continue;
+			}
+			int64_t hostTime = 0;
+			if (!cameras[i].clock.ToHostTime(timestamps[i], hostTime))
+			{
+				continue;
+			}
+			first = count == 0 ? hostTime : min(first, hostTime);
+			last = count == 0 ? hostTime : max(last, hostTime);
+			count++;
+		}
+		if (count < 2)
+		{
+			return;
+		}
+
+		lock_guard<mutex> lock(m_statsMutex);
+		m_skewSets++;
+		m_skewSumNs += static_cast<double>(last - first);
+		m_skewMaxNs = max(m_skewMaxNs, last - first);
+	}
+
+	void GetSkewStats(unsigned int & sets, double & meanUs, double & maxUs)
+	{
+		lock_guard<mutex> lock(m_statsMutex);
+		sets = m_skewSets;
+		meanUs = m_skewSets > 0 ? m_skewSumNs / m_skewSets / 1000.0 : 0.0;
+		maxUs = m_skewMaxNs / 1000.0;
+	}
+
+	void PrintTriggerStats()
+	{
+		lock_guard<mutex> lock(m_statsMutex);
+		if (m_fires == 0 && m_skewSets == 0)
+		{
+			return;
+		}
+
+		cout << endl << "*** TRIGGER SKEW ***" << endl << endl;
+		if (m_fires > 0)
+		{
+			cout << "Trigger fanout host time mean/max: " << m_fireSumUs / m_fires << " / " << m_fireMaxUs << " us over " << m_fires << " triggers" << endl;
+		}
+		if (m_skewSets > 0)
+		{
+			cout << "Inter-camera skew mean/max: " << m_skewSumNs / m_skewSets / 1000.0 << " / " << m_skewMaxNs / 1000.0 << " us over " << m_skewSets << " sets" << endl;
+		}
+		cout << endl;
+	}
+
+private:
+	void RunWorker(CameraSlot * slot)
+	{
+		unsigned int seen = 0;
+		for (;;)
+		{
+			{
+				unique_lock<mutex> lock(m_mutex);
+				m_go.wait(lock, [&] { return m_stop || m_generation != seen; });
+				if (m_stop)
+				{
+					return;
+				}
+				seen = m_generation;
+			}
+
+			int result = 0;
+			if (slot->state.load() == CAMERA_STREAMING && slot->softwareTriggered)
+			{
+				try
+				{
+					if (IsAvailable(slot->ptrTriggerSoftware) && IsWritable(slot->ptrTriggerSoftware))
+					{
+						slot->ptrTriggerSoftware->Execute();
+					}
+					else
+					{
+						cout << "Unable to execute trigger on camera " << slot->index << "..." << endl;
+						result = -1;
+					}
+				}
+				catch (Spinnaker::Exception &e)
+				{
+					cout << "Error: " << e.what() << endl;
+					result = -1;
+				}
+			}
+
+			lock_guard<mutex> lock(m_mutex);
+			m_result |= result;
+			if (--m_pending == 0)
+			{
+				m_done.notify_one();
+			}
+		}
+	}
+
+	// Action commands need every software-triggered camera to be a GigE
+	// camera with an Action0 trigger source.
+	static bool SupportsActionCommands(SystemPtr system, vector<CameraSlot> & cameras)
+	{
+		CCommandPtr ptrActionCommand = system->GetTLNodeMap().GetNode("ActionCommand");
+		if (!IsAvailable(ptrActionCommand))
+		{
+			return false;
+		}
+
+		for (unsigned int i = 0; i < cameras.size(); i++)
+		{
+			CEnumerationPtr ptrTriggerSource = cameras[i].pCam->GetNodeMap().GetNode("TriggerSource");
+			if (!IsAvailable(ptrTriggerSource) || !IsReadable(ptrTriggerSource)
+				|| ptrTriggerSource->GetCurrentEntry()->GetSymbolic() != "Software")
+			{
+				continue;
+			}
+
+			CEnumerationPtr ptrDeviceType = cameras[i].pCam->GetTLDeviceNodeMap().GetNode("DeviceType");
+			CEnumEntryPtr ptrAction0 = ptrTriggerSource->GetEntryByName("Action0");
+			if (!IsAvailable(ptrDeviceType) || !IsReadable(ptrDeviceType) || ptrDeviceType->GetCurrentEntry()->GetSymbolic() != "GigEVision"
+				|| !IsAvailable(ptrAction0) || !IsReadable(ptrAction0))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Sets the keys of the action command sent by the system and resolves the
+	// command handle.
+	bool ConfigureActionCommand(SystemPtr system)
+	{
+		INodeMap & nodeMapTL = system->GetTLNodeMap();
+
+		CIntegerPtr ptrDeviceKey = nodeMapTL.GetNode("ActionDeviceKey");
+		CIntegerPtr ptrGroupKey = nodeMapTL.GetNode("ActionGroupKey");
+		CIntegerPtr ptrGroupMask = nodeMapTL.GetNode("ActionGroupMask");
+		CIntegerPtr ptrDestination = nodeMapTL.GetNode("GevActionDestinationIPAddress");
+		m_ptrActionCommand = nodeMapTL.GetNode("ActionCommand");
+		if (!IsAvailable(ptrDeviceKey) || !IsWritable(ptrDeviceKey) || !IsAvailable(ptrGroupKey) || !IsWritable(ptrGroupKey)
+			|| !IsAvailable(ptrGroupMask) || !IsWritable(ptrGroupMask) || !IsAvailable(m_ptrActionCommand) || !IsWritable(m_ptrActionCommand))
+		{
+			return false;
+		}
+
+		ptrDeviceKey->SetValue(k_actionDeviceKey);
+		ptrGroupKey->SetValue(k_actionGroupKey);
+		ptrGroupMask->SetValue(k_actionGroupMask);
+		if (IsAvailable(ptrDestination) && IsWritable(ptrDestination))
+		{
+			// Broadcast to all cameras on the interface
+			ptrDestination->SetValue(0xFFFFFFFF);
+		}
+		return true;
+	}
+
+	// Switches a software-triggered camera to the Action0 trigger source with
+	// matching keys. The trigger must be disabled while the source changes.
+	// Returns false, leaving the camera unchanged, if the nodes are locked.
+	static bool ConfigureActionTrigger(INodeMap & nodeMap)
+	{
+		CEnumerationPtr ptrTriggerMode = nodeMap.GetNode("TriggerMode");
+		CEnumerationPtr ptrTriggerSource = nodeMap.GetNode("TriggerSource");
+		if (!IsAvailable(ptrTriggerMode) || !IsWritable(ptrTriggerMode) || !IsAvailable(ptrTriggerSource) || !IsWritable(ptrTriggerSource))
+		{
+			return false;
+		}
+		CEnumEntryPtr ptrAction0 = ptrTriggerSource->GetEntryByName("Action0");
+		if (!IsAvailable(ptrAction0) || !IsReadable(ptrAction0))
+		{
+			return false;
+		}
+		ptrTriggerMode->SetIntValue(ptrTriggerMode->GetEntryByName("Off")->GetValue());
+
+		CIntegerPtr ptrDeviceKey = nodeMap.GetNode("ActionDeviceKey");
+		CIntegerPtr ptrSelector = nodeMap.GetNode("ActionSelector");
+		CIntegerPtr ptrGroupKey = nodeMap.GetNode("ActionGroupKey");
+		CIntegerPtr ptrGroupMask = nodeMap.GetNode("ActionGroupMask");
+		if (IsAvailable(ptrSelector) && IsWritable(ptrSelector))
+		{
+			ptrSelector->SetValue(0);
+		}
+		if (IsAvailable(ptrDeviceKey) && IsWritable(ptrDeviceKey))
+		{
+			ptrDeviceKey->SetValue(k_actionDeviceKey);
+		}
+		if (IsAvailable(ptrGroupKey) && IsWritable(ptrGroupKey))
+		{
+			ptrGroupKey->SetValue(k_actionGroupKey);
+		}
+		if (IsAvailable(ptrGroupMask) && IsWritable(ptrGroupMask))
+		{
+			ptrGroupMask->SetValue(k_actionGroupMask);
+		}
+
+		ptrTriggerSource->SetIntValue(ptrAction0->GetValue());
+		ptrTriggerMode->SetIntValue(ptrTriggerMode->GetEntryByName("On")->GetValue());
+		return true;
+	}
+
+	vector<CameraSlot> * m_cameras;
+	bool m_useActionCommand;
+	CCommandPtr m_ptrActionCommand;
+
+	vector<thread> m_workers;
+	mutex m_mutex;
+	condition_variable m_go;
+	condition_variable m_done;
+	bool m_stop;
+	unsigned int m_generation;
+	unsigned int m_pending;
+	int m_result;
+
+	mutex m_statsMutex;
+	unsigned int m_skewSets;
+	double m_skewSumNs;
+	int64_t m_skewMaxNs;
+	double m_fireSumUs;
+	double m_fireMaxUs;
+	unsigned int m_fires;
+};
+
+TriggerFanout triggerFanout;
+
+// Set k_enableAutoExposure to let the auto-exposure controller drive 
+// ExposureTime and Gain of all cameras together. It aims for a mean level of
+// k_autoExposureTarget on the 8-bit scale while keeping the saturated 
+// fraction below k_autoExposureMaxSaturation. Exposure time is raised first,
+// up to k_autoExposureMaxTime; any further brightness comes from gain. Off
+// by default, so that cameras keep the fixed exposure they are configured
+// with unless a setup opts in.
+const bool k_enableAutoExposure = false;
+const double k_autoExposureTarget = 110.0;
+const double k_autoExposureDeadband = 8.0;
+const double k_autoExposureMaxSaturation = 0.01;
+const double k_autoExposureMaxTime = 20000.0;	// in microseconds
+const double k_autoExposureMaxGain = 18.0;		// in dB
+const double k_autoExposureDamping = 0.5;		// exponent applied to each correction
+
+// This class is the auto-exposure controller. The acquisition loop computes 
+// ImageStats for every complete 8-bit image and calls Update() once all 
+// images of a set are in, i.e. before the next trigger, so every camera of
+// the next set is exposed with the same settings. Settings are written 
+// through node handles resolved once per camera in Attach().
+class AutoExposure
+{
+public:
+	AutoExposure() : m_initialized(false), m_exposureTime(0.0), m_gain(0.0), m_mean(0.0), m_saturation(0.0), m_updates(0) {}
+
+	// Resolves the exposure handles of a camera and hands control over to the
+	// controller. Called when streaming starts and after a camera is 
+	// recovered.
+	void Attach(CameraSlot & slot)
+	{
+		INodeMap & nodeMap = slot.pCam->GetNodeMap();
+		slot.ptrExposureTime = nodeMap.GetNode("ExposureTime");
+		slot.ptrGain = nodeMap.GetNode("Gain");
+		slot.statsValid = false;
+
+		if (!k_enableAutoExposure)
+		{
+			return;
+		}
+
+		// The camera's own auto modes must be off for the values to be writable
+		CEnumerationPtr ptrExposureAuto = nodeMap.GetNode("ExposureAuto");
+		if (IsAvailable(ptrExposureAuto) && IsWritable(ptrExposureAuto))
+		{
+			ptrExposureAuto->SetIntValue(ptrExposureAuto->GetEntryByName("Off")->GetValue());
+		}
+		CEnumerationPtr ptrGainAuto = nodeMap.GetNode("GainAuto");
+		if (IsAvailable(ptrGainAuto) && IsWritable(ptrGainAuto))
+		{
+			ptrGainAuto->SetIntValue(ptrGainAuto->GetEntryByName("Off")->GetValue());
+		}
+
+		lock_guard<mutex> lock(m_mutex);
+		if (m_initialized)
+		{
+			Apply(slot);
+		}
+	}
+
+	// Moves the operating point, e.g. when a profile is selected. The 
+	// controller continues from there.
+	void SetOperatingPoint(double exposureTime, double gain)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_exposureTime = exposureTime;
+		m_gain = gain;
+		m_initialized = true;
+	}
+
+	// Combines the statistics of the last set and, if the set is off target,
+	// applies new settings to every streaming camera.
+	void Update(vector<CameraSlot> & cameras)
+	{
+		if (!k_enableAutoExposure)
+		{
+			return;
+		}
+
+		double meanSum = 0.0;
+		double saturation = 0.0;
+		unsigned int count = 0;
+		for (unsigned int i = 0; i < cameras.size(); i++)
+		{
+			if (!cameras[i].statsValid)
+			{
+				continue;
+			}
+			meanSum += cameras[i].stats.Mean();
+			saturation = max(saturation, cameras[i].stats.SaturatedFraction());
+			cameras[i].statsValid = false;
+			count++;
+		}
+		if (count == 0)
+		{
+			return;
+		}
+
+		lock_guard<mutex> lock(m_mutex);
+		m_mean = meanSum / count;
+		m_saturation = saturation;
+
+		// Start from the settings of the first camera
+		if (!m_initialized)
+		{
+			for (unsigned int i = 0; i < cameras.size() && !m_initialized; i++)
+			{
+				if (cameras[i].state.load() == CAMERA_STREAMING && IsAvailable(cameras[i].ptrExposureTime) && IsReadable(cameras[i].ptrExposureTime)
+					&& IsAvailable(cameras[i].ptrGain) && IsReadable(cameras[i].ptrGain))
+				{
+					m_exposureTime = cameras[i].ptrExposureTime->GetValue();
+					m_gain = cameras[i].ptrGain->GetValue();
+					m_initialized = true;
+				}
+			}
+			if (!m_initialized)
+			{
+				return;
+			}
+		}
+
+		// Correction factor on the total exposure (time times linear gain)
+		double correction = k_autoExposureTarget / max(m_mean, 1.0);
+		if (m_saturation > k_autoExposureMaxSaturation)
+		{
+			correction = min(correction, 0.7);
+		}
+		else if (fabs(m_mean - k_autoExposureTarget) < k_autoExposureDeadband)
+		{
+			return;
+		}
+		correction = min(max(pow(correction, k_autoExposureDamping), 0.5), 2.0);
+
+		// Split the new total into exposure time first, then gain
+		double total = m_exposureTime * pow(10.0, m_gain / 20.0) * correction;
+		m_exposureTime = min(total, k_autoExposureMaxTime);
+		m_gain = min(max(20.0 * log10(total / m_exposureTime), 0.0), k_autoExposureMaxGain);
+		m_updates++;
+
+		for (unsigned int i = 0; i < cameras.size(); i++)
+		{
+			if (cameras[i].state.load() == CAMERA_STREAMING)
+			{
+				Apply(cameras[i]);
+			}
+		}
+	}
+
+	void GetState(double & exposureTime, double & gain, double & mean, double & saturation)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		exposureTime = m_exposureTime;
+		gain = m_gain;
+		mean = m_mean;
+		saturation = m_saturation;
+	}
+
+	void PrintAutoExposureStats()
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (!k_enableAutoExposure || !m_initialized)
+		{
+			return;
+		}
+
+		cout << endl << "*** AUTO EXPOSURE ***" << endl << endl;
+		cout << "Exposure " << m_exposureTime << " us, gain " << m_gain << " dB after " << m_updates << " updates" << endl;
+		cout << "Last mean level " << m_mean << ", saturated " << m_saturation * 100.0 << "%" << endl << endl;
+	}
+
+private:
+	// Writes the current settings to a camera within its limits and updates
+	// the cached configuration used for recovery. Called with m_mutex held.
+	void Apply(CameraSlot & slot)
+	{
+		try
+		{
+			if (IsAvailable(slot.ptrExposureTime) && IsWritable(slot.ptrExposureTime))
+			{
+				slot.exposureTime = min(max(m_exposureTime, slot.ptrExposureTime->GetMin()), slot.ptrExposureTime->GetMax());
+				slot.ptrExposureTime->SetValue(slot.exposureTime);
+			}
+			if (IsAvailable(slot.ptrGain) && IsWritable(slot.ptrGain))
+			{
+				slot.gain = min(max(m_gain, slot.ptrGain->GetMin()), slot.ptrGain->GetMax());
+				slot.ptrGain->SetValue(slot.gain);
+			}
+		}
+		catch (Spinnaker::Exception &e)
+		{
+			cout << "Error: " << e.what() << endl;
+		}
+	}
+
+	mutex m_mutex;
+	bool m_initialized;
+	double m_exposureTime;
+	double m_gain;
+	double m_mean;
+	double m_saturation;
+	unsigned int m_updates;
+};
+
+AutoExposure autoExposure;
+
+// This function triggers the next synchronized set. In this example, only a
+// single image per camera is captured and made available for acquisition - 
+// as such, attempting to acquire two images for a single trigger execution 
+// would cause the example to hang. This is different from other examples, 
+// whereby a constant stream of images are being captured and made available
+// for image acquisition.
+int GrabNextImageByTrigger()
+{
+	int result = 0;
+
+	// 
+	// Use trigger to capture image
+	//
+	// *** NOTES ***
+	// The software trigger only feigns being executed by the Enter key;
+	// what might not be immediately apparent is that there is not a
+	// continuous stream of images being captured; in other examples that 
+	// acquire images, the camera captures a continuous stream of images. 
+	// When an image is retrieved, it is plucked from the stream.
+	//
+	// All software-triggered cameras are fired together by the trigger 
+	// fanout; cameras left on Line3 follow the primary camera.
+	//
+	if (chosenTrigger == SOFTWARE)
+	{
+		// Get user input
+		if (interactiveMode)
+		{
+			cout << "Press the Enter key to initiate software trigger." << endl;
+			getchar();
+		}
+
+		// Execute software trigger
+		result = triggerFanout.Fire();
+
+		// TODO: Blackfly and Flea3 GEV cameras need 2 second delay after software trigger 
+	}
+	else if (chosenTrigger == HARDWARE && interactiveMode)
+	{
+		// Execute hardware trigger
+		cout << "Use the hardware to trigger image acquisition." << endl;
+	}
+
+	return result;
+}
+
+// This function sets a camera to continuous acquisition and starts streaming.
+int StartAcquisition(CameraPtr pCam, unsigned int camIndex)
+{
+	// Set acquisition mode to continuous
+	CEnumerationPtr ptrAcquisitionMode = pCam->GetNodeMap().GetNode("AcquisitionMode");
+	if (!IsAvailable(ptrAcquisitionMode) || !IsWritable(ptrAcquisitionMode))
+	{
+		cout << "Unable to set acquisition mode to continuous (node retrieval; camera " << camIndex << "). Aborting..." << endl << endl;
+		return -1;
+	}
+	CEnumEntryPtr ptrAcquisitionModeContinuous = ptrAcquisitionMode->GetEntryByName("Continuous");
+	if (!IsAvailable(ptrAcquisitionModeContinuous) || !IsReadable(ptrAcquisitionModeContinuous))
+	{
+		cout << "Unable to set acquisition mode to continuous (entry 'continuous' retrieval " << camIndex << "). Aborting..." << endl << endl;
+		return -1;
+	}
+	int64_t acquisitionModeContinuous = ptrAcquisitionModeContinuous->GetValue();
+	ptrAcquisitionMode->SetIntValue(acquisitionModeContinuous);
+	cout << "Camera " << camIndex << " acquisition mode set to continuous..." << endl;
+
+	// Begin acquiring images
+	pCam->BeginAcquisition();
+	cout << "Camera " << camIndex << " started acquiring images..." << endl;
+
+	return 0;
+}
+
+// This function reads back the settings that a recovered camera must be
+// given again. ConfigureTrigger() and ConfigureChunkData() are replayed as 
+// they are; exposure and gain are cached here because they may have been 
+// changed after configuration.
+void CacheCameraConfiguration(INodeMap & nodeMap, CameraSlot & slot)
+{
+	slot.exposureTime = -1.0;
+	slot.gain = -1.0;
+
+	CFloatPtr ptrExposureTime = nodeMap.GetNode("ExposureTime");
+	if (IsAvailable(ptrExposureTime) && IsReadable(ptrExposureTime))
+	{
+		slot.exposureTime = ptrExposureTime->GetValue();
+	}
+	CFloatPtr ptrGain = nodeMap.GetNode("Gain");
+	if (IsAvailable(ptrGain) && IsReadable(ptrGain))
+	{
+		slot.gain = ptrGain->GetValue();
+	}
+}
+
+// This function applies the cached configuration to a freshly initialized
+// camera.
+int ApplyCameraConfiguration(INodeMap & nodeMap, const CameraSlot & slot)
+{
+	int result = ConfigureTrigger(nodeMap);
+	if (result < 0)
+	{
+		return result;
+	}
+	result = ConfigureChunkData(nodeMap);
+	if (result < 0)
+	{
+		return result;
+	}
+
+	// Exposure and gain are only writable with their automatic modes off
+	CEnumerationPtr ptrExposureAuto = nodeMap.GetNode("ExposureAuto");
+	CFloatPtr ptrExposureTime = nodeMap.GetNode("ExposureTime");
+	if (slot.exposureTime > 0.0 && IsAvailable(ptrExposureAuto) && IsReadable(ptrExposureAuto)
+		&& ptrExposureAuto->GetCurrentEntry()->GetSymbolic() == "Off" && IsAvailable(ptrExposureTime) && IsWritable(ptrExposureTime))
+	{
+		ptrExposureTime->SetValue(slot.exposureTime);
+	}
+	CEnumerationPtr ptrGainAuto = nodeMap.GetNode("GainAuto");
+	CFloatPtr ptrGain = nodeMap.GetNode("Gain");
+	if (slot.gain >= 0.0 && IsAvailable(ptrGainAuto) && IsReadable(ptrGainAuto)
+		&& ptrGainAuto->GetCurrentEntry()->GetSymbolic() == "Off" && IsAvailable(ptrGain) && IsWritable(ptrGain))
+	{
+		ptrGain->SetValue(slot.gain);
+	}
+
+	return 0;
+}
+
+// This function runs on the recovery thread of a removed camera. It tears
+// down the stale camera, waits for the device to reappear, re-initializes it 
+// with the cached configuration and hands it back to the acquisition loop.
+void RecoverCamera(SystemPtr system, CameraSlot & slot)
+{
+	string serialNumber(slot.serialNumber.c_str());
+
+	try
+	{
+		if (slot.pCam->IsStreaming())
+		{
+			slot.pCam->EndAcquisition();
+		}
+		slot.pCam->DeInit();
+	}
+	catch (Spinnaker::Exception &)
+	{
+		// The device is gone; the stale handle is released below
+	}
+	{
+		lock_guard<mutex> handleLock(slot.handleMutex);
+		slot.pCam = NULL;
+	}
+
+	bool recovered = false;
+	if (deviceEventHandler.WaitForArrival(serialNumber, k_recoveryTimeoutMs))
+	{
+		try
+		{
+			CameraList camList = system->GetCameras();
+			CameraPtr pCam = camList.GetBySerial(serialNumber);
+			camList.Clear();
+
+			if (pCam.IsValid())
+			{
+				pCam->Init();
+				bool started = false;
+				if (ApplyCameraConfiguration(pCam->GetNodeMap(), slot) == 0)
+				{
+					triggerFanout.Configure(pCam, slot.index);
+					started = StartAcquisition(pCam, slot.index) == 0;
+				}
+				if (started)
+				{
+					{
+						lock_guard<mutex> handleLock(slot.handleMutex);
+						slot.pCam = pCam;
+					}
+					triggerFanout.Attach(slot);
+					clockSync.Attach(slot);
+					autoExposure.Attach(slot);
+					recovered = true;
+				}
+				else
+				{
+					pCam->DeInit();
+				}
+			}
+		}
+		catch (Spinnaker::Exception &e)
+		{
+			cout << "Error: " << e.what() << endl;
+		}
+	}
+
+	double recoveryTimeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - slot.removedAt).count();
+	deviceEventHandler.RecordRecovery(recoveryTimeMs, recovered);
+
+	if (recovered)
+	{
+		cout << "Camera " << slot.index << " recovered after " << recoveryTimeMs << " ms..." << endl << endl;
+		slot.state.store(CAMERA_STREAMING);
+	}
+	else
+	{
+		cout << "Camera " << slot.index << " could not be recovered..." << endl << endl;
+		slot.state.store(CAMERA_LOST);
+	}
+}
+
+// This function takes a removed camera out of the synchronized set and starts
+// its recovery thread. The other cameras keep streaming meanwhile.
+void BeginCameraRecovery(SystemPtr system, CameraSlot & slot)
+{
+	cout << "Camera " << slot.index << " dropped off the bus, recovering..." << endl << endl;
+
+	deviceEventHandler.RecordDisconnect();
+	slot.removedAt = chrono::steady_clock::now();
+	slot.state.store(CAMERA_RECOVERING);
+
+	if (slot.recoveryThread.joinable())
+	{
+		slot.recoveryThread.join();
+	}
+	slot.recoveryThread = thread(RecoverCamera, system, ref(slot));
+}
+
+// This function waits for the next image of a camera. Unlike a plain 
+// GetNextImage() it gives up once the camera has been removed, so that a dead
+// camera cannot stall the acquisition loop. An interruptible wait also gives
+// up when grabInterrupted is raised by the daemon control thread; this is 
+// only allowed before the first image of a synchronized set is retrieved so
+// that sets never get split.
+ImagePtr GetNextImageOrRemoval(CameraSlot & slot, bool interruptible)
+{
+	for (;;)
+	{
+		try
+		{
+			return slot.pCam->GetNextImage(k_grabTimeoutMs);
+		}
+		catch (Spinnaker::Exception &e)
+		{
+			if (e.GetError() != SPINNAKER_ERR_TIMEOUT || deviceEventHandler.IsRemoved(slot.serialNumber.c_str())
+				|| (interruptible && grabInterrupted.load()))
+			{
+				throw;
+			}
+		}
+	}
+}
+
+// Set k_enableFrameBus to publish the live frames of every camera on a
+// shared-memory ring of k_frameBusSlots frames (see FrameBus.h).
+const bool k_enableFrameBus = true;
+const unsigned int k_frameBusSlots = 8;
+
+// This function creates the frame bus ring of a camera, sized from the
+// camera's payload size. Replays publish on rings of their own, so that a
+// replay never takes over the ring of a running daemon.
+void CreateFrameBus(CameraSlot & slot, uint32_t payloadSize)
+{
+	ostringstream serialNumber;
+	if (slot.serialNumber != "")
+	{
+		serialNumber << slot.serialNumber.c_str();
+	}
+	else
+	{
+		serialNumber << slot.index;
+	}
+
+	string name = FrameBusName((replayMode ? "replay-" : "") + serialNumber.str());
+	if (slot.frameBus.Create(name, k_frameBusSlots, payloadSize, serialNumber.str()))
+	{
+		cout << "Camera " << slot.index << " frames published on " << name << "..." << endl;
+	}
+	else
+	{
+		cout << "Unable to create frame bus " << name << ", it may be in use by another instance; frame bus disabled..." << endl;
+	}
+}
+
+void OpenFrameBus(CameraSlot & slot)
+{
+	if (!k_enableFrameBus)
+	{
+		return;
+	}
+
+	CIntegerPtr ptrPayloadSize = slot.pCam->GetNodeMap().GetNode("PayloadSize");
+	if (!IsAvailable(ptrPayloadSize) || !IsReadable(ptrPayloadSize))
+	{
+		cout << "Unable to read payload size of camera " << slot.index << ", frame bus disabled..." << endl;
+		return;
+	}
+
+	CreateFrameBus(slot, static_cast<uint32_t>(ptrPayloadSize->GetValue()));
+}
+
+// This function builds the common part of all filenames of a camera.
+string CameraFileBase(const string & filePrefix, const CameraSlot & slot)
+{
+	ostringstream fileBase;
+	fileBase << filePrefix << "AcquisitionMultipleCamera-";
+	if (slot.serialNumber != "")
+	{
+		fileBase << slot.serialNumber.c_str();
+	}
+	else
+	{
+		fileBase << slot.index;
+	}
+	return fileBase.str();
+}
+
+// Set k_recordSegments to record the raw frames of each camera into segment
+// files (see Recording.h) instead of saving every frame as a JPEG. Segments 
+// roll over after k_segmentMaxBytes or k_segmentMaxSeconds, whichever comes
+// first. k_segmentFinalizeCommand, if not empty, is run on every finalized
+// segment with its path appended, e.g. "zstd -q --rm" to compress it; it is
+// split at spaces and run without a shell. A 
+// warning is printed while the disk holding the recording is forecast to 
+// fill within k_diskWarnSeconds.
+const bool k_recordSegments = true;
+const uint64_t k_segmentMaxBytes = 1ULL << 30;
+const unsigned int k_segmentMaxSeconds = 300;
+const char * const k_segmentFinalizeCommand = "";
+const double k_diskWarnSeconds = 600.0;
+
+// Runs from the start of a run to its end, so that closing a session never
+// waits for the finalization of its last segments.
+SegmentFinalizer segmentFinalizer;
+DiskForecaster diskForecaster;
+
+// This function persists one frame of a recording session: its metadata
+// record, and either the raw frame appended to the camera's segments or the
+// frame converted to mono 8 and saved as JPEG.
+void SaveFrame(CameraSlot & slot, const string & filePrefix, uint64_t setSequence, const ImagePtr & pImage, const FrameMetadataRecord & record)
+{
+	// Record chunk data before the image is converted
+	WriteFrameMetadata(slot.metadataFile, record);
+
+	// Print image information
+	cout << "Camera " << slot.index << " grabbed image " << record.imageCnt << ", width = " << pImage->GetWidth() << ", height = " << pImage->GetHeight() << endl;
+
+	if (k_recordSegments)
+	{
+		if (!slot.recorder.Write(record, setSequence, static_cast<uint32_t>(pImage->GetWidth()), static_cast<uint32_t>(pImage->GetHeight()),
+			static_cast<uint32_t>(pImage->GetPixelFormat()), pImage->GetData(), static_cast<uint32_t>(pImage->GetImageSize())))
+		{
+			cout << "Camera " << slot.index << " failed to record image " << record.imageCnt << "..." << endl;
+			return;
+		}
+		slot.savedImages++;
+		return;
+	}
+
+	// Convert image to mono 8
+	ImagePtr convertedImage = slot.pipeline->PrepareForEncode(pImage);
+
+	// Create a unique filename
+	ostringstream filename;
+	filename << CameraFileBase(filePrefix, slot) << "-" << record.imageCnt << ".jpg";
+
+	// Save image
+	convertedImage->Save(filename.str().c_str());
+	slot.savedImages++;
+	cout << "Image saved at " << filename.str() << endl;
+}
+
+// Set k_enableMotionGate to persist only the synchronized sets in which the
+// scene changes. A set opens the gate when the fraction of changed blocks of
+// any camera reaches k_gateOnFraction, and the gate closes again after
+// k_gatePostRollSets sets below k_gateOffFraction. The k_gatePreRollSets
+// sets before the gate opens are kept in memory and persisted with it, so the
+// onset of a change is never lost. Only the areas in k_gateRegions take part
+// in change detection.
+const bool k_enableMotionGate = false;
+const uint8_t k_gatePixelThreshold = 12;
+const double k_gateOnFraction = 0.005;
+const double k_gateOffFraction = 0.002;
+const unsigned int k_gatePreRollSets = 10;
+const unsigned int k_gatePostRollSets = 20;
+const ChangeRegion k_gateRegions[] = { { 0.0, 0.0, 1.0, 1.0 } };
+const unsigned int k_numGateRegions = sizeof(k_gateRegions) / sizeof(k_gateRegions[0]);
+
+// A frame held by the motion gate until its set is persisted or dropped.
+struct PendingFrame
+{
+	bool valid;
+	vector<unsigned char> data;
+	size_t width;
+	size_t height;
+	PixelFormatEnums pixelFormat;
+	uint64_t setSequence;
+	FrameMetadataRecord record;
+};
+
+// This class is the motion gate. The acquisition loop scores and holds every
+// frame of a set, then calls EndSet(), which either persists the set (after
+// the pre-roll) or moves it into the pre-roll ring. Frame buffers are
+// recycled between the current set and the ring, so holding a frame is a
+// single copy without allocation once the ring is warm.
+class MotionGate
+{
+public:
+	MotionGate() : m_active(false), m_quietSets(0), m_preRollStart(0), m_preRollCount(0) { ResetCounters(); }
+
+	// Starts a session with an empty pre-roll and a closed gate.
+	void Reset(vector<CameraSlot> & cameras)
+	{
+		m_current.assign(cameras.size(), PendingFrame());
+		m_preRoll.assign(k_gatePreRollSets, vector<PendingFrame>(cameras.size(), PendingFrame()));
+		for (unsigned int i = 0; i < cameras.size(); i++)
+		{
+			m_current[i].valid = false;
+			cameras[i].changeDetector.Reset();
+		}
+		m_preRollStart = 0;
+		m_preRollCount = 0;
+		m_active = false;
+		m_quietSets = 0;
+		ResetCounters();
+	}
+
+	// Returns the change score of a frame from its 8-bit plane. Frames 
+	// without a plane count as changed, so that they are always recorded.
+	double Score(CameraSlot & slot, const LumaPlane & plane)
+	{
+		if (plane.data == NULL)
+		{
+			return 1.0;
+		}
+		return slot.changeDetector.Update(plane.data, plane.width, plane.height, plane.stride, k_gateRegions, k_numGateRegions, k_gatePixelThreshold);
+	}
+
+	// Copies a frame into the current set.
+	void Hold(unsigned int camIndex, uint64_t setSequence, const ImagePtr & pImage, const FrameMetadataRecord & record)
+	{
+		PendingFrame & frame = m_current[camIndex];
+		const unsigned char * data = static_cast<const unsigned char *>(pImage->GetData());
+		frame.data.assign(data, data + pImage->GetImageSize());
+		frame.width = pImage->GetWidth();
+		frame.height = pImage->GetHeight();
+		frame.pixelFormat = pImage->GetPixelFormat();
+		frame.setSequence = setSequence;
+		frame.record = record;
+		frame.valid = true;
+	}
+
+	// Decides on the current set and persists or buffers it.
+	void EndSet(vector<CameraSlot> & cameras, const string & filePrefix, double score)
+	{
+		// Hysteresis: open at the on level, close after a quiet post-roll
+		if (score >= k_gateOnFraction)
+		{
+			if (!m_active)
+			{
+				cout << "Motion gate opened (score " << score << ")..." << endl;
+			}
+			m_active = true;
+			m_quietSets = 0;
+		}
+		else if (m_active && score < k_gateOffFraction && ++m_quietSets > k_gatePostRollSets)
+		{
+			cout << "Motion gate closed..." << endl;
+			m_active = false;
+		}
+		else if (m_active && score >= k_gateOffFraction)
+		{
+			m_quietSets = 0;
+		}
+
+		uint64_t setBytes = SetBytes(m_current);
+		{
+			lock_guard<mutex> lock(m_statsMutex);
+			m_setsSeen++;
+			m_bytesSeen += setBytes;
+		}
+
+		if (m_active)
+		{
+			// Flush the pre-roll oldest first, then the current set
+			for (unsigned int n = 0; n < m_preRollCount; n++)
+			{
+				vector<PendingFrame> & set = m_preRoll[(m_preRollStart + n) % k_gatePreRollSets];
+				Persist(cameras, filePrefix, set);
+			}
+			m_preRollStart = 0;
+			m_preRollCount = 0;
+			Persist(cameras, filePrefix, m_current);
+		}
+		else if (k_gatePreRollSets > 0)
+		{
+			// Buffer the set, recycling the buffers of the oldest one
+			unsigned int slotIndex = (m_preRollStart + m_preRollCount) % k_gatePreRollSets;
+			if (m_preRollCount == k_gatePreRollSets)
+			{
+				m_preRollStart = (m_preRollStart + 1) % k_gatePreRollSets;
+			}
+			else
+			{
+				m_preRollCount++;
+			}
+			m_preRoll[slotIndex].swap(m_current);
+		}
+
+		for (size_t i = 0; i < m_current.size(); i++)
+		{
+			m_current[i].valid = false;
+		}
+	}
+
+	// Called from the control thread as well.
+	void GetGateStats(uint64_t & setsSeen, uint64_t & setsPersisted, double & storageReduction)
+	{
+		lock_guard<mutex> lock(m_statsMutex);
+		setsSeen = m_setsSeen;
+		setsPersisted = m_setsPersisted;
+		storageReduction = m_bytesSeen > 0 ? 1.0 - static_cast<double>(m_bytesPersisted) / m_bytesSeen : 0.0;
+	}
+
+	void PrintGateStats()
+	{
+		uint64_t setsSeen = 0;
+		uint64_t setsPersisted = 0;
+		double storageReduction = 0.0;
+		GetGateStats(setsSeen, setsPersisted, storageReduction);
+		if (!k_enableMotionGate || setsSeen == 0)
+		{
+			return;
+		}
+
+		cout << endl << "*** MOTION GATE ***" << endl << endl;
+		cout << "Persisted " << setsPersisted << " of " << setsSeen << " sets, storage reduced by " << storageReduction * 100.0 << "%" << endl << endl;
+	}
+
+private:
+	void Persist(vector<CameraSlot> & cameras, const string & filePrefix, vector<PendingFrame> & set)
+	{
+		for (unsigned int i = 0; i < set.size(); i++)
+		{
+			if (!set[i].valid)
+			{
+				continue;
+			}
+			ImagePtr pImage = Image::Create(set[i].width, set[i].height, 0, 0, set[i].pixelFormat, &set[i].data[0]);
+			SaveFrame(cameras[i], filePrefix, set[i].setSequence, pImage, set[i].record);
+			set[i].valid = false;
+		}
+		lock_guard<mutex> lock(m_statsMutex);
+		m_setsPersisted++;
+		m_bytesPersisted += SetBytes(set);
+	}
+
+	static uint64_t SetBytes(const vector<PendingFrame> & set)
+	{
+		uint64_t bytes = 0;
+		for (size_t i = 0; i < set.size(); i++)
+		{
+			bytes += set[i].data.size();
+		}
+		return bytes;
+	}
+
+	void ResetCounters()
+	{
+		lock_guard<mutex> lock(m_statsMutex);
+		m_setsSeen = 0;
+		m_setsPersisted = 0;
+		m_bytesSeen = 0;
+		m_bytesPersisted = 0;
+	}
+
+	vector<PendingFrame> m_current;
+	vector<vector<PendingFrame> > m_preRoll;
+	bool m_active;
+	unsigned int m_quietSets;
+	unsigned int m_preRollStart;
+	unsigned int m_preRollCount;
+
+	// Guards the counters, which the control thread reads
+	mutex m_statsMutex;
+	uint64_t m_setsSeen;
+	uint64_t m_setsPersisted;
+	uint64_t m_bytesSeen;
+	uint64_t m_bytesPersisted;
+};
+
+MotionGate motionGate;
+
+// Host wall-clock window of the frames a recording session saves, given by
+// the start and stop times of a multi-host session. A frame is saved if its
+// hostTimestamp lies in [startAt, stopAt); a zero bound is open. A bounded
+// window leaves out frames without a host timestamp, as the session agents
+// do, so that the session index and the recordings hold the same frames.
+// Only the acquisition thread uses it.
+struct SessionWindow
+{
+	int64_t startAt;
+	int64_t stopAt;
+	bool passed;		// a frame at or after stopAt was grabbed
+
+	SessionWindow() : startAt(0), stopAt(0), passed(false) {}
+
+	// Returns true if a frame is to be saved.
+	bool Admit(int64_t hostTimestamp)
+	{
+		if (startAt == 0 && stopAt == 0)
+		{
+			return true;
+		}
+		if (stopAt != 0 && hostTimestamp >= stopAt)
+		{
+			passed = true;
+			return false;
+		}
+		return hostTimestamp != 0 && hostTimestamp >= startAt;
+	}
+};
+
+SessionWindow sessionWindow;
+
+// This function selects the processing chain of a camera for a pixel format.
+// It runs once per session, when the format is read from the camera or the
+// recording, and again only if a frame arrives in another format.
+void SelectFramePipeline(CameraSlot & slot, PixelFormatEnums pixelFormat)
+{
+	slot.pipeline.reset(CreateFramePipeline(pixelFormat));
+	cout << "Camera " << slot.index << " processing pipeline selected for pixel format " << pixelFormat << "..." << endl;
+}
+
+// This function starts streaming on every camera. Cameras stay streaming
+// until StopCameras() is called, across any number of sessions.
+int StartCameras(SystemPtr system, vector<CameraSlot> & cameras)
+{
+	triggerFanout.Start(system, cameras);
+
+	for (unsigned int i = 0; i < cameras.size(); i++)
+	{
+		triggerFanout.Configure(cameras[i].pCam, i);
+		if (StartAcquisition(cameras[i].pCam, i) < 0)
+		{
+			return -1;
+		}
+
+		// Pick the processing chain for the session's pixel format
+		CEnumerationPtr ptrPixelFormat = cameras[i].pCam->GetNodeMap().GetNode("PixelFormat");
+		if (IsAvailable(ptrPixelFormat) && IsReadable(ptrPixelFormat))
+		{
+			SelectFramePipeline(cameras[i], static_cast<PixelFormatEnums>(ptrPixelFormat->GetIntValue()));
+		}
+		triggerFanout.Attach(cameras[i]);
+		clockSync.Attach(cameras[i]);
+		autoExposure.Attach(cameras[i]);
+		if (!cameras[i].frameBus.IsOpen())
+		{
+			OpenFrameBus(cameras[i]);
+		}
+		cameras[i].state.store(CAMERA_STREAMING);
+	}
+	cout << endl;
+
+	clockSync.Start(cameras);
+
+	return 0;
+}
+
+// This function opens the output of a recording session for every camera.
+void OpenSession(vector<CameraSlot> & cameras, const string & filePrefix)
+{
+	for (unsigned int i = 0; i < cameras.size(); i++)
+	{
+		cameras[i].missedImages = 0;
+		cameras[i].savedImages = 0;
+
+		// Open per-frame metadata stream
+		cameras[i].metadataFile = OpenFrameMetadata(CameraFileBase(filePrefix, cameras[i]), cameras[i].serialNumber, i);
+
+		// Open the first segment of the recording
+		if (k_recordSegments)
+		{
+			if (!cameras[i].recorder.Open(CameraFileBase(filePrefix, cameras[i]), cameras[i].serialNumber.c_str(), i, k_segmentMaxBytes,
+				static_cast<int64_t>(k_segmentMaxSeconds) * 1000000000LL, k_segmentFinalizeCommand, &segmentFinalizer))
+			{
+				cout << "Camera " << i << " failed to open recording " << CameraFileBase(filePrefix, cameras[i]) << "..." << endl;
+			}
+		}
+	}
+	cout << endl;
+
+	if (k_recordSegments)
+	{
+		diskForecaster.Reset(filePrefix);
+	}
+
+	if (k_enableMotionGate)
+	{
+		motionGate.Reset(cameras);
+	}
+}
+
+// This function closes the output of a recording session.
+void CloseSession(vector<CameraSlot> & cameras)
+{
+	motionGate.PrintGateStats();
+
+	for (unsigned int i = 0; i < cameras.size(); i++)
+	{
+		if (cameras[i].missedImages > 0)
+		{
+			cout << "Camera " << i << " missed " << cameras[i].missedImages << " images while disconnected..." << endl;
+		}
+
+		// Flush and close metadata stream
+		if (cameras[i].metadataFile != NULL)
+		{
+			fclose(cameras[i].metadataFile);
+			cameras[i].metadataFile = NULL;
+		}
+	}
+
+	// Close the last segments; they are finalized in the background
+	if (k_recordSegments)
+	{
+		for (unsigned int i = 0; i < cameras.size(); i++)
+		{
+			cameras[i].recorder.Close();
+			cout << "Camera " << i << " recorded " << cameras[i].recorder.TotalBytes() << " bytes in " << cameras[i].recorder.Segments() << " segments";
+			if (cameras[i].recorder.Stalls() > 0)
+			{
+				cout << ", " << cameras[i].recorder.Stalls() << " rollovers waited for preallocation";
+			}
+			if (cameras[i].recorder.Failures() > 0)
+			{
+				cout << ", " << cameras[i].recorder.Failures() << " write failures";
+			}
+			cout << endl;
+		}
+	}
+}
+
+// This function stops streaming on every camera. Recovery threads still 
+// waiting for their device are woken up and joined first.
+void StopCameras(vector<CameraSlot> & cameras)
+{
+	deviceEventHandler.Shutdown();
+	for (unsigned int i = 0; i < cameras.size(); i++)
+	{
+		if (cameras[i].recoveryThread.joinable())
+		{
+			cameras[i].recoveryThread.join();
+		}
+	}
+	deviceEventHandler.Restart();
+	triggerFanout.Stop();
+	clockSync.Stop();
+
+	//
+	// End acquisition for each camera
+	//
+	// *** NOTES ***
+	// Notice that what is usually a one-step process is now two steps
+	// because of the additional step of selecting the camera. It is worth
+	// repeating that camera selection needs to be done once per loop.
+	//
+	for (unsigned int i = 0; i < cameras.size(); i++)
+	{
+		try
+		{
+			// End acquisition
+			if (cameras[i].state.load() == CAMERA_STREAMING)
+			{
+				cameras[i].pCam->EndAcquisition();
+			}
+		}
+		catch (Spinnaker::Exception &e)
+		{
+			cout << "Error: " << e.what() << endl;
+		}
+
+		// Remove the frame bus ring
+		if (cameras[i].frameBus.IsOpen())
+		{
+			if (cameras[i].frameBus.LappedReaders() > 0)
+			{
+				cout << "Camera " << i << " frame bus readers fell behind " << cameras[i].frameBus.LappedReaders() << " times..." << endl;
+			}
+			cameras[i].frameBus.Close();
+		}
+	}
+
+	deviceEventHandler.PrintRecoveryStats();
+	triggerFanout.PrintTriggerStats();
+	clockSync.PrintClockStats(cameras);
+	autoExposure.PrintAutoExposureStats();
+}
+
+// This function finds the next set of a replay: the earliest recorded set 
+// that any replayed camera still has to deliver. Returns false at the end of
+// the recording.
+bool NextReplaySet(vector<CameraSlot> & cameras, uint64_t & setSequence)
+{
+	bool found = false;
+	for (unsigned int i = 0; i < cameras.size(); i++)
+	{
+		uint64_t next = 0;
+		if (cameras[i].replay != NULL && cameras[i].replay->PeekSetSequence(next) && (!found || next < setSequence))
+		{
+			setSequence = next;
+			found = true;
+		}
+	}
+	return found;
+}
+
+// This function triggers and retrieves one synchronized set, i.e. one image
+// from every streaming camera. Images are saved only if save is set; 
+// otherwise they are released right away, which keeps the cameras streaming
+// between recording sessions. Returns 1 if the set was interrupted before any
+// image was retrieved, or in replay mode once the recording is exhausted.
+int GrabSynchronizedSet(SystemPtr system, vector<CameraSlot> & cameras, unsigned int imageCnt, const string & filePrefix, bool save)
+{
+	int result = 0;
+	bool setStarted = false;
+
+	// Chunk timestamps of the set, for the skew measurement
+	vector<int64_t> timestamps(cameras.size(), -1);
+
+	// Sequence number of the set on the frame bus; only the acquisition loop
+	// grabs sets
+	static uint64_t setSequence = 0;
+	setSequence++;
+
+	// Highest change score of the set, for the motion gate
+	double setScore = 0.0;
+
+	// Trigger all cameras at once. A replay is paced by the recording
+	// instead, and keeps the recorded set numbers; returns 1 once every
+	// recorded set has been replayed.
+	if (!replayMode)
+	{
+		result = result | GrabNextImageByTrigger();
+	}
+	else if (!NextReplaySet(cameras, setSequence))
+	{
+		return 1;
+	}
+
+	for (unsigned int i = 0; i < cameras.size(); i++)
+	{
+		CameraSlot & slot = cameras[i];
+		if (slot.state.load() != CAMERA_STREAMING)
+		{
+			if (save)
+			{
+				slot.missedImages++;
+			}
+			continue;
+		}
+
+		// Cameras that did not record this set miss it, as they did live
+		uint64_t replaySet = 0;
+		if (slot.replay != NULL && (!slot.replay->PeekSetSequence(replaySet) || replaySet != setSequence))
+		{
+			if (save)
+			{
+				slot.missedImages++;
+			}
+			continue;
+		}
+
+		if (!replayMode && (int)i == k_simulatedDisconnectCamera && imageCnt == k_simulatedDisconnectImage)
+		{
+			deviceEventHandler.InjectRemoval(slot.serialNumber.c_str());
+			deviceEventHandler.InjectArrival(slot.serialNumber.c_str());
+			BeginCameraRecovery(system, slot);
+			slot.missedImages++;
+			continue;
+		}
+
+		try
+		{
+			// Retrieve next received image and ensure image completion. A
+			// replayed frame comes with its recorded metadata.
+			ImagePtr pResultImage;
+			FrameMetadataRecord record;
+			if (slot.replay != NULL)
+			{
+				slot.replay->GetNextImage(pResultImage, record, replaySet);
+			}
+			else
+			{
+				pResultImage = GetNextImageOrRemoval(slot, !setStarted && chosenTrigger == HARDWARE);
+			}
+			setStarted = true;
+			slot.grabbedImages++;
+
+			if (pResultImage->IsIncomplete())
+			{
+				slot.incompleteImages++;
+				cout << "Image incomplete with image status " << pResultImage->GetImageStatus() << "..." << endl << endl;
+			}
+			else
+			{
+				// Parse chunk data once for the metadata stream, the frame bus
+				// and the skew measurement
+				if (slot.replay == NULL)
+				{
+					ReadFrameMetadata(record, pResultImage, imageCnt);
+					record.hostTimestamp = clockSync.ToWallTime(slot.clock, static_cast<int64_t>(record.timestamp));
+				}
+				else
+				{
+					record.imageCnt = imageCnt;
+				}
+				timestamps[i] = static_cast<int64_t>(record.timestamp);
+				bool saveFrame = save && sessionWindow.Admit(record.hostTimestamp);
+
+				// Reduce the frame to its 8-bit plane once, for the statistics
+				// and the motion gate
+				if (!slot.pipeline || slot.pipeline->Format() != pResultImage->GetPixelFormat())
+				{
+					SelectFramePipeline(slot, pResultImage->GetPixelFormat());
+				}
+				const LumaPlane * plane = NULL;
+				if (k_enableAutoExposure || (save && k_enableMotionGate))
+				{
+					plane = &slot.pipeline->Process(pResultImage);
+				}
+
+				// Brightness statistics for the auto-exposure controller
+				if (k_enableAutoExposure)
+				{
+					ComputeImageStats(plane->data, plane->width, plane->height, plane->stride, slot.stats);
+					slot.statsValid = true;
+				}
+
+				// Publish the raw frame to shared memory consumers
+				slot.frameBus.Publish(record, setSequence, static_cast<uint32_t>(pResultImage->GetWidth()), static_cast<uint32_t>(pResultImage->GetHeight()),
+					static_cast<uint32_t>(pResultImage->GetPixelFormat()), pResultImage->GetData(), pResultImage->GetImageSize());
+
+				if (saveFrame && k_enableMotionGate)
+				{
+					// Hold the frame until the gate has decided on the set
+					double score = motionGate.Score(slot, *plane);
+					setScore = max(setScore, score);
+					motionGate.Hold(i, setSequence, pResultImage, record);
+				}
+				else if (saveFrame)
+				{
+					SaveFrame(slot, filePrefix, setSequence, pResultImage, record);
+				}
+			}
+
+			// Release image back to its stream buffer; replayed images
+			// wrap the mapped recording and have no buffer
+			if (slot.replay == NULL)
+			{
+				pResultImage->Release();
+			}
+			if (save)
+			{
+				cout << endl;
+			}
+		}
+		catch (Spinnaker::Exception &e)
+		{
+			if (slot.replay == NULL && (deviceEventHandler.IsRemoved(slot.serialNumber.c_str()) || !slot.pCam->IsValid()))
+			{
+				slot.missedImages++;
+				BeginCameraRecovery(system, slot);
+			}
+			else if (!setStarted && grabInterrupted.load())
+			{
+				return 1;
+			}
+			else
+			{
+				cout << "Error: " << e.what() << endl;
+				result = -1;
+			}
+		}
+	}
+
+	// Persist or buffer the set
+	if (save && k_enableMotionGate)
+	{
+		motionGate.EndSet(cameras, filePrefix, setScore);
+	}
+
+	// Warn while the recording disk is about to fill up
+	if (save && k_recordSegments)
+	{
+		uint64_t bytesWritten = 0;
+		uint64_t bytesReserved = 0;
+		for (unsigned int i = 0; i < cameras.size(); i++)
+		{
+			bytesWritten += cameras[i].recorder.TotalBytes();
+			bytesReserved += cameras[i].recorder.ReservedBytes();
+		}
+		if (diskForecaster.Update(bytesWritten, bytesReserved) && diskForecaster.SecondsLeft() >= 0.0 && diskForecaster.SecondsLeft() < k_diskWarnSeconds)
+		{
+			cout << "Warning: disk full in " << static_cast<int>(diskForecaster.SecondsLeft()) << " s at " << diskForecaster.BytesPerSecond() / 1e6 << " MB/s ("
+				<< diskForecaster.FreeBytes() / 1000000 << " MB free)..." << endl;
+		}
+	}
+
+	triggerFanout.RecordSet(cameras, timestamps);
+
+	// Adjust exposure before the next trigger
+	if (!replayMode)
+	{
+		autoExposure.Update(cameras);
+	}
+
+	return result;
+}
+
+// This function acquires and saves 10 images from each device.  
+int AcquireImages(SystemPtr system, vector<CameraSlot> & cameras)
+{
+	int result = 0;
+
+	cout << endl << "*** IMAGE ACQUISITION ***" << endl << endl;
+
+	try
+	{
+		//
+		// Prepare each camera to acquire images
+		// 
+		// *** NOTES ***
+		// For pseudo-simultaneous streaming, each camera is prepared as if it 
+		// were just one, but in a loop. Notice that cameras are selected with 
+		// an index. We demonstrate pseduo-simultaneous streaming because true 
+		// simultaneous streaming would require multiple process or threads,
+		// which is too complex for an example. 
+		// 
+		// Serial numbers and metadata streams are kept in the camera slots,
+		// which outlive a camera that is removed and recovered.
+		//
+		if (StartCameras(system, cameras) < 0)
+		{
+			return -1;
+		}
+		segmentFinalizer.Start();
+		OpenSession(cameras, "");
+
+		//
+		// Retrieve, convert, and save images for each camera
+		//
+		// *** NOTES ***
+		// In order to work with simultaneous camera streams, nested loops are
+		// needed. It is important that the inner loop be the one iterating
+		// through the cameras; otherwise, all images will be grabbed from a
+		// single camera before grabbing any images from another.
+		//
+		// A camera that is being recovered is skipped; it rejoins the loop as
+		// soon as its recovery thread marks it streaming again.
+		//
+		const unsigned int k_numImages = 10;
+
+		for (unsigned int imageCnt = 0; imageCnt < k_numImages; imageCnt++)
+		{
+			result = result | GrabSynchronizedSet(system, cameras, imageCnt, "", true);
+		}
+
+		CloseSession(cameras);
+		StopCameras(cameras);
+
+		// Wait until every segment is finalized
+		segmentFinalizer.Stop();
+	}
+	catch (Spinnaker::Exception &e)
+	{
+		cout << "Error: " << e.what() << endl;
+		result = -1;
+	}
+
+	return result;
+}
+
+// Speed of a replay relative to the recording when none is given on the 
+// command line, and whether replayed frames are recorded again, which
+// exercises the segment writer as well.
+const double k_defaultReplaySpeed = 1.0;
+const bool k_replaySave = true;
+
+// This function replays recorded segments through the acquisition loop. The
+// segments are grouped into one ReplayCamera per recorded camera, and every
+// set then runs through the same processing as live frames: statistics, the
+// frame bus, the motion gate and the segment writer. Throughput and the
+// frames the pipeline could not take on time are reported at the end.
+int RunReplay(SystemPtr system, const vector<string> & segmentPaths, double speed)
+{
+	int result = 0;
+
+	cout << endl << "*** REPLAY ***" << endl << endl;
+
+	// Group segments by camera: names differ only in the segment number
+	map<string, vector<string> > recordings;
+	for (unsigned int i = 0; i < segmentPaths.size(); i++)
+	{
+		const string & path = segmentPaths[i];
+		string::size_type dash = path.rfind('-');
+		recordings[dash == string::npos ? path : path.substr(0, dash)].push_back(path);
+	}
+
+	vector<ReplayCamera> replays(recordings.size());
+	vector<CameraSlot> cameras(recordings.size());
+
+	unsigned int i = 0;
+	for (map<string, vector<string> >::iterator it = recordings.begin(); it != recordings.end(); ++it, i++)
+	{
+		if (!replays[i].Open(it->second))
+		{
+			cout << "Unable to open recording " << it->first << ". Aborting..." << endl;
+			return -1;
+		}
+		replays[i].SetSpeed(speed);
+
+		CameraSlot & slot = cameras[i];
+		slot.index = i;
+		slot.serialNumber = replays[i].SerialNumber().c_str();
+		slot.metadataFile = NULL;
+		slot.grabbedImages = 0;
+		slot.incompleteImages = 0;
+		slot.savedImages = 0;
+		slot.missedImages = 0;
+		slot.softwareTriggered = false;
+		slot.statsValid = false;
+		slot.replay = &replays[i];
+		slot.state.store(CAMERA_STREAMING);
+
+		cout << "Camera " << i << " replays " << it->second.size() << " segments of " << it->first << "..." << endl;
+		SelectFramePipeline(slot, static_cast<PixelFormatEnums>(replays[i].PixelFormat()));
+		if (k_enableFrameBus)
+		{
+			CreateFrameBus(slot, replays[i].MaxFrameSize());
+		}
+	}
+
+	if (k_replaySave)
+	{
+		segmentFinalizer.Start();
+		OpenSession(cameras, "replay-");
+	}
+
+	// All cameras are paced from the earliest recorded host timestamp
+	int64_t baseTimestamp = 0;
+	for (i = 0; i < replays.size(); i++)
+	{
+		int64_t first = replays[i].FirstHostTimestamp();
+		if (first > 0 && (baseTimestamp == 0 || first < baseTimestamp))
+		{
+			baseTimestamp = first;
+		}
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (i = 0; i < replays.size(); i++)
+	{
+		replays[i].BeginAcquisition(start, baseTimestamp);
+	}
+
+	unsigned int imageCnt = 0;
+	for (;;)
+	{
+		int err = GrabSynchronizedSet(system, cameras, imageCnt, "replay-", k_replaySave);
+		if (err == 1)
+		{
+			break;
+		}
+		result = result | err;
+		imageCnt++;
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	if (k_replaySave)
+	{
+		CloseSession(cameras);
+		segmentFinalizer.Stop();
+	}
+
+	cout << endl << "*** REPLAY STATISTICS ***" << endl << endl;
+	cout << "Replayed " << imageCnt << " sets in " << seconds << " s (" << (seconds > 0.0 ? imageCnt / seconds : 0.0) << " sets/s)" << endl;
+	for (i = 0; i < replays.size(); i++)
+	{
+		cout << "Camera " << i << " delivered " << replays[i].DeliveredFrames() << " frames";
+		if (speed > 0.0)
+		{
+			cout << ", " << replays[i].LateFrames() << " late, max lag " << replays[i].MaxLagMs() << " ms";
+		}
+		cout << endl;
+
+		replays[i].EndAcquisition();
+		cameras[i].frameBus.Close();
+	}
+	cout << endl;
+
+	return result;
+}
+
+
+
+// This function acquires and saves 10 images from a device; please see
+// Acquisition example for more in-depth comments on acquiring images.
+//int AcquireImages(CameraPtr pCam, INodeMap & nodeMap, INodeMap & nodeMapTLDevice)
+//{
+//	int result = 0;
+//
+//	cout << endl << "*** IMAGE ACQUISITION ***" << endl << endl;
+//
+//	try
+//	{
+//		// Set acquisition mode to continuous
+//		CEnumerationPtr ptrAcquisitionMode = nodeMap.GetNode("AcquisitionMode");
+//		if (!IsAvailable(ptrAcquisitionMode) || !IsWritable(ptrAcquisitionMode))
+//		{
+//			cout << "Unable to set acquisition mode to continuous (node retrieval). Aborting..." << endl << endl;
+//			return -1;
+//		}
+//		CEnumEntryPtr ptrAcquisitionModeContinuous = ptrAcquisitionMode->GetEntryByName("Continuous");
+//		if (!IsAvailable(ptrAcquisitionModeContinuous) || !IsReadable(ptrAcquisitionModeContinuous))
+//		{
+//			cout << "Unable to set acquisition mode to continuous (entry 'continuous' retrieval). Aborting..." << endl << endl;
+//			return -1;
+//		}
+//		int64_t acquisitionModeContinuous = ptrAcquisitionModeContinuous->GetValue();
 //		ptrAcquisitionMode->SetIntValue(acquisitionModeContinuous);
 //		cout << "Acquisition mode set to continuous..." << endl;
 //
@@ -805,7 +3091,501 @@ int AcquireImages(CameraList camList)
 //}
 
 
-int RunMultipleCameras(CameraList camList)
+//
+// Daemon mode
+//
+// *** NOTES ***
+// Started with --daemon, the program keeps all cameras initialized and 
+// streaming and is driven through the local control socket (see 
+// ControlSocket.h). Each request is one JSON object per line with a "cmd"
+// key:
+//
+//   {"cmd":"start","name":"run1"}   start recording a session
+//   {"cmd":"stop"}                  stop recording
+//   {"cmd":"profile","name":"fast"} switch acquisition profile
+//   {"cmd":"trigger","count":1}     fire software triggers
+//   {"cmd":"stats"}                 query acquisition statistics
+//   {"cmd":"shutdown"}              stop the daemon
+//
+// Every request is answered with one JSON object carrying "ok" and either
+// the result or an "error" message. Changes are applied by the acquisition
+// thread between synchronized sets.
+//
+// Start and stop take an optional "at", a host wall-clock time in ns since
+// the epoch. The session then saves only the frames whose hostTimestamp lies
+// between the start and stop times (see SessionWindow) and stays open until
+// the frames up to the stop time are in.
+//
+struct AcquisitionProfile
+{
+	const char * name;
+	double exposureTime;	// in microseconds
+	double gain;			// in dB
+};
+
+const AcquisitionProfile k_profiles[] =
+{
+	{ "default", 4000.0, 0.0 },
+	{ "fast", 1000.0, 6.0 },
+	{ "lowlight", 16000.0, 12.0 }
+};
+const unsigned int k_numProfiles = sizeof(k_profiles) / sizeof(k_profiles[0]);
+
+// Set by the shutdown command or by SIGINT/SIGTERM.
+atomic<bool> shutdownRequested(false);
+
+// Time after its stop time at which a session is closed even if no later
+// frame arrived, e.g. with a software trigger or disconnected cameras.
+const int64_t k_sessionStopGraceNs = 1000000000;
+
+void OnShutdownSignal(int /*signal*/)
+{
+	shutdownRequested.store(true);
+	grabInterrupted.store(true);
+}
+
+// State shared between the control thread and the acquisition thread. The
+// control thread only posts requests; the acquisition thread carries them 
+// out and publishes the result.
+struct DaemonState
+{
+	mutex lock;
+	condition_variable wake;
+
+	// Requests
+	bool recordingRequested;
+	string requestedSession;
+	int64_t requestedStartAt;		// 0 to save from the next set
+	int64_t requestedStopAt;		// 0 to stop at the next set
+	int pendingProfile;
+	unsigned int pendingTriggers;
+
+	// Published by the acquisition thread
+	bool recording;
+	string activeSession;
+	int activeProfile;
+	unsigned int sessionCount;
+	unsigned int setsGrabbed;
+	unsigned int setsRecorded;
+};
+
+// This function applies an acquisition profile to every streaming camera and
+// updates the cached configuration used for recovery.
+int ApplyProfile(vector<CameraSlot> & cameras, const AcquisitionProfile & profile)
+{
+	int result = 0;
+
+	for (unsigned int i = 0; i < cameras.size(); i++)
+	{
+		if (cameras[i].state.load() != CAMERA_STREAMING)
+		{
+			continue;
+		}
+
+		try
+		{
+			INodeMap & nodeMap = cameras[i].pCam->GetNodeMap();
+
+			// Turn off automatic exposure and gain
+			CEnumerationPtr ptrExposureAuto = nodeMap.GetNode("ExposureAuto");
+			if (IsAvailable(ptrExposureAuto) && IsWritable(ptrExposureAuto))
+			{
+				ptrExposureAuto->SetIntValue(ptrExposureAuto->GetEntryByName("Off")->GetValue());
+			}
+			CEnumerationPtr ptrGainAuto = nodeMap.GetNode("GainAuto");
+			if (IsAvailable(ptrGainAuto) && IsWritable(ptrGainAuto))
+			{
+				ptrGainAuto->SetIntValue(ptrGainAuto->GetEntryByName("Off")->GetValue());
+			}
+
+			// Set exposure and gain within the camera limits
+			CFloatPtr ptrExposureTime = nodeMap.GetNode("ExposureTime");
+			CFloatPtr ptrGain = nodeMap.GetNode("Gain");
+			if (!IsAvailable(ptrExposureTime) || !IsWritable(ptrExposureTime) || !IsAvailable(ptrGain) || !IsWritable(ptrGain))
+			{
+				cout << "Unable to apply profile " << profile.name << " to camera " << i << "..." << endl;
+				result = -1;
+				continue;
+			}
+			ptrExposureTime->SetValue(min(max(profile.exposureTime, ptrExposureTime->GetMin()), ptrExposureTime->GetMax()));
+			ptrGain->SetValue(min(max(profile.gain, ptrGain->GetMin()), ptrGain->GetMax()));
+
+			CacheCameraConfiguration(nodeMap, cameras[i]);
+		}
+		catch (Spinnaker::Exception &e)
+		{
+			cout << "Error: " << e.what() << endl;
+			result = -1;
+		}
+	}
+
+	// The auto-exposure controller continues from the profile settings
+	autoExposure.SetOperatingPoint(profile.exposureTime, profile.gain);
+
+	cout << "Profile " << profile.name << " applied..." << endl;
+
+	return result;
+}
+
+// This function returns true if the acquisition thread has a session to open,
+// or one to close whose frames up to its stop time are in. Called with the
+// state locked.
+bool SessionChangeDue(const DaemonState & state)
+{
+	if (state.recording && !state.recordingRequested)
+	{
+		return state.requestedStopAt == 0 || sessionWindow.passed || ClockSync::WallNow() >= state.requestedStopAt + k_sessionStopGraceNs;
+	}
+	return !state.recording && state.recordingRequested;
+}
+
+// This function is the body of the daemon acquisition thread. It grabs 
+// synchronized sets for as long as the daemon runs: continuously with a 
+// hardware trigger, once per requested trigger with a software trigger. Sets
+// are only saved while a session is recording.
+void RunDaemonAcquisition(SystemPtr system, vector<CameraSlot> & cameras, DaemonState & state)
+{
+	unsigned int imageCnt = 0;
+	string filePrefix;
+	bool recording = false;
+
+	while (!shutdownRequested.load())
+	{
+		{
+			unique_lock<mutex> lock(state.lock);
+			if (chosenTrigger == SOFTWARE)
+			{
+				state.wake.wait_for(lock, chrono::milliseconds(100), [&]
+				{
+					return shutdownRequested.load() || state.pendingTriggers > 0 || state.pendingProfile >= 0 || SessionChangeDue(state);
+				});
+			}
+			grabInterrupted.store(shutdownRequested.load());
+			if (shutdownRequested.load())
+			{
+				break;
+			}
+
+			// Apply a pending profile between sets
+			if (state.pendingProfile >= 0)
+			{
+				ApplyProfile(cameras, k_profiles[state.pendingProfile]);
+				state.activeProfile = state.pendingProfile;
+				state.pendingProfile = -1;
+			}
+
+			// Close and open sessions
+			if (state.recording && !state.recordingRequested && SessionChangeDue(state))
+			{
+				CloseSession(cameras);
+				cout << "Session " << state.activeSession << " stopped after " << imageCnt << " sets..." << endl << endl;
+				state.recording = false;
+				state.activeSession = "";
+				sessionWindow = SessionWindow();
+			}
+			if (!state.recording && state.recordingRequested)
+			{
+				sessionWindow.startAt = state.requestedStartAt;
+				state.activeSession = state.requestedSession;
+				state.sessionCount++;
+				state.setsRecorded = 0;
+				state.recording = true;
+				imageCnt = 0;
+				filePrefix = state.activeSession + "-";
+				cout << "Session " << state.activeSession << " started..." << endl;
+				OpenSession(cameras, filePrefix);
+			}
+			if (state.recording)
+			{
+				sessionWindow.stopAt = state.recordingRequested ? 0 : state.requestedStopAt;
+			}
+			recording = state.recording;
+
+			if (chosenTrigger == SOFTWARE)
+			{
+				if (state.pendingTriggers == 0)
+				{
+					continue;
+				}
+				state.pendingTriggers--;
+			}
+		}
+
+		if (GrabSynchronizedSet(system, cameras, imageCnt, filePrefix, recording) == 1)
+		{
+			// Interrupted by a control request before the set started
+			continue;
+		}
+
+		lock_guard<mutex> lock(state.lock);
+		state.setsGrabbed++;
+		if (recording)
+		{
+			state.setsRecorded++;
+			imageCnt++;
+		}
+	}
+
+	lock_guard<mutex> lock(state.lock);
+	if (state.recording)
+	{
+		CloseSession(cameras);
+		state.recording = false;
+	}
+}
+
+// This function carries out one control request and returns the response.
+string HandleControlCommand(const string & request, vector<CameraSlot> & cameras, DaemonState & state)
+{
+	ostringstream response;
+	string cmd = JsonGetValue(request, "cmd");
+
+	lock_guard<mutex> lock(state.lock);
+
+	if (cmd == "start")
+	{
+		if (state.recordingRequested)
+		{
+			return "{\"ok\":false,\"error\":\"already recording\"}";
+		}
+		if (state.recording)
+		{
+			return "{\"ok\":false,\"error\":\"previous session still stopping\"}";
+		}
+		string name = JsonGetValue(request, "name");
+		if (name.empty())
+		{
+			ostringstream defaultName;
+			defaultName << "Session" << state.sessionCount + 1;
+			name = defaultName.str();
+		}
+		else if (!IsValidName(name))
+		{
+			// The name becomes a file prefix and reaches the finalize command
+			return "{\"ok\":false,\"error\":\"invalid name\"}";
+		}
+		state.requestedSession = name;
+		state.requestedStartAt = atoll(JsonGetValue(request, "at").c_str());
+		state.requestedStopAt = 0;
+		state.recordingRequested = true;
+		response << "{\"ok\":true,\"session\":\"" << JsonEscape(name) << "\"}";
+	}
+	else if (cmd == "stop")
+	{
+		if (!state.recordingRequested)
+		{
+			return "{\"ok\":false,\"error\":\"not recording\"}";
+		}
+		state.requestedStopAt = atoll(JsonGetValue(request, "at").c_str());
+		state.recordingRequested = false;
+		response << "{\"ok\":true}";
+	}
+	else if (cmd == "profile")
+	{
+		string name = JsonGetValue(request, "name");
+		unsigned int profile = 0;
+		while (profile < k_numProfiles && name != k_profiles[profile].name)
+		{
+			profile++;
+		}
+		if (profile == k_numProfiles)
+		{
+			return "{\"ok\":false,\"error\":\"unknown profile\"}";
+		}
+		state.pendingProfile = profile;
+		response << "{\"ok\":true,\"profile\":\"" << k_profiles[profile].name << "\"}";
+	}
+	else if (cmd == "trigger")
+	{
+		if (chosenTrigger != SOFTWARE)
+		{
+			return "{\"ok\":false,\"error\":\"hardware trigger selected\"}";
+		}
+		int count = atoi(JsonGetValue(request, "count").c_str());
+		state.pendingTriggers += count > 0 ? count : 1;
+		response << "{\"ok\":true,\"pending\":" << state.pendingTriggers << "}";
+	}
+	else if (cmd == "stats")
+	{
+		unsigned int skewSets = 0;
+		double skewMeanUs = 0.0;
+		double skewMaxUs = 0.0;
+		triggerFanout.GetSkewStats(skewSets, skewMeanUs, skewMaxUs);
+		double exposureTime = 0.0;
+		double gain = 0.0;
+		double meanLevel = 0.0;
+		double saturation = 0.0;
+		autoExposure.GetState(exposureTime, gain, meanLevel, saturation);
+		uint64_t gateSetsSeen = 0;
+		uint64_t gateSetsPersisted = 0;
+		double gateStorageReduction = 0.0;
+		motionGate.GetGateStats(gateSetsSeen, gateSetsPersisted, gateStorageReduction);
+
+		response << "{\"ok\":true,\"recording\":" << (state.recording ? "true" : "false")
+			<< ",\"session\":\"" << JsonEscape(state.activeSession) << "\""
+			<< ",\"profile\":\"" << (state.activeProfile >= 0 ? k_profiles[state.activeProfile].name : "") << "\""
+			<< ",\"sessions\":" << state.sessionCount
+			<< ",\"setsGrabbed\":" << state.setsGrabbed
+			<< ",\"setsRecorded\":" << state.setsRecorded
+			<< ",\"skewSets\":" << skewSets
+			<< ",\"skewMeanUs\":" << skewMeanUs
+			<< ",\"skewMaxUs\":" << skewMaxUs
+			<< ",\"exposureUs\":" << exposureTime
+			<< ",\"gainDb\":" << gain
+			<< ",\"meanLevel\":" << meanLevel
+			<< ",\"saturated\":" << saturation
+			<< ",\"diskSecondsLeft\":" << diskForecaster.SecondsLeft()
+			<< ",\"gateSetsSeen\":" << gateSetsSeen
+			<< ",\"gateSetsPersisted\":" << gateSetsPersisted
+			<< ",\"gateStorageReduction\":" << gateStorageReduction
+			<< ",\"cameras\":[";
+		for (unsigned int i = 0; i < cameras.size(); i++)
+		{
+			double driftPpm = 0.0;
+			double residualUs = 0.0;
+			unsigned int samples = 0;
+			cameras[i].clock.GetFit(driftPpm, residualUs, samples);
+			const char * stateName = cameras[i].state.load() == CAMERA_STREAMING ? "streaming"
+				: cameras[i].state.load() == CAMERA_RECOVERING ? "recovering" : "lost";
+			response << (i > 0 ? "," : "") << "{\"index\":" << i
+				<< ",\"serial\":\"" << JsonEscape(cameras[i].serialNumber.c_str()) << "\""
+				<< ",\"state\":\"" << stateName << "\""
+				<< ",\"grabbed\":" << cameras[i].grabbedImages.load()
+				<< ",\"incomplete\":" << cameras[i].incompleteImages.load()
+				<< ",\"saved\":" << cameras[i].savedImages.load()
+				<< ",\"missed\":" << cameras[i].missedImages.load()
+				<< ",\"driftPpm\":" << driftPpm
+				<< ",\"clockResidualUs\":" << residualUs << "}";
+		}
+		response << "]}";
+		return response.str();
+	}
+	else if (cmd == "shutdown")
+	{
+		shutdownRequested.store(true);
+		response << "{\"ok\":true}";
+	}
+	else
+	{
+		return "{\"ok\":false,\"error\":\"unknown command\"}";
+	}
+
+	// Release an acquisition thread blocked on a camera so that the request
+	// is carried out before the next set
+	grabInterrupted.store(true);
+	state.wake.notify_all();
+
+	return response.str();
+}
+
+// This function runs the daemon: it starts streaming on all cameras and 
+// serves control requests until shutdown. Only one control client is served
+// at a time.
+int RunDaemon(SystemPtr system, vector<CameraSlot> & cameras, const string & controlAddress)
+{
+	cout << endl << "*** DAEMON MODE ***" << endl << endl;
+
+	if (!InitSockets())
+	{
+		cout << "Unable to initialize sockets. Aborting..." << endl;
+		return -1;
+	}
+	socket_t listener = ListenControlSocket(controlAddress);
+	if (listener == INVALID_SOCKET)
+	{
+		cout << "Unable to listen on control address " << controlAddress << "; is another daemon running? Aborting..." << endl;
+		CleanupSockets();
+		return -1;
+	}
+	cout << "Listening for control requests on " << controlAddress << "..." << endl << endl;
+
+	signal(SIGINT, OnShutdownSignal);
+	signal(SIGTERM, OnShutdownSignal);
+
+	int result = 0;
+	try
+	{
+		if (StartCameras(system, cameras) < 0)
+		{
+			CloseControlSocket(listener, controlAddress);
+			CleanupSockets();
+			return -1;
+		}
+
+		segmentFinalizer.Start();
+
+		DaemonState state;
+		state.recordingRequested = false;
+		state.requestedStartAt = 0;
+		state.requestedStopAt = 0;
+		state.pendingProfile = -1;
+		state.pendingTriggers = 0;
+		state.recording = false;
+		state.activeProfile = -1;
+		state.sessionCount = 0;
+		state.setsGrabbed = 0;
+		state.setsRecorded = 0;
+
+		thread acquisitionThread(RunDaemonAcquisition, system, ref(cameras), ref(state));
+
+		while (!shutdownRequested.load())
+		{
+			if (!WaitReadable(listener, 200))
+			{
+				continue;
+			}
+			socket_t client = accept(listener, NULL, NULL);
+			if (client == INVALID_SOCKET)
+			{
+				continue;
+			}
+
+			string buffer;
+			string request;
+			while (!shutdownRequested.load())
+			{
+				if (buffer.find('\n') == string::npos && !WaitReadable(client, 200))
+				{
+					continue;
+				}
+				if (!ReadLine(client, buffer, request))
+				{
+					break;
+				}
+				if (!request.empty() && !SendAll(client, HandleControlCommand(request, cameras, state) + "\n"))
+				{
+					break;
+				}
+			}
+			closesocket(client);
+		}
+
+		state.wake.notify_all();
+		acquisitionThread.join();
+
+		StopCameras(cameras);
+
+		// Wait until every segment is finalized; no lock is held here
+		segmentFinalizer.Stop();
+	}
+	catch (Spinnaker::Exception &e)
+	{
+		cout << "Error: " << e.what() << endl;
+		result = -1;
+	}
+
+	CloseControlSocket(listener, controlAddress);
+	CleanupSockets();
+
+	cout << "Daemon stopped..." << endl << endl;
+
+	return result;
+}
+
+
+// This function runs the cameras either for a single interactive acquisition
+// or, when a control address is given, as a daemon.
+int RunMultipleCameras(SystemPtr system, CameraList camList, const string & controlAddress)
 {
 	int result = 0;
 	CameraPtr pCam = NULL;
@@ -856,25 +3636,81 @@ int RunMultipleCameras(CameraList camList)
 		//	pCam->Init();
 		//}
 
+		//
+		// Fill one slot per camera
+		//
+		// *** NOTES ***
+		// The acquisition loop works on the slots rather than on the camera
+		// list, because a camera that is removed and recovered comes back as
+		// a new CameraPtr.
+		//
+		vector<CameraSlot> cameras(camList.GetSize());
+
+		for (unsigned int i = 0; i < cameras.size(); i++)
+		{
+			CameraSlot & slot = cameras[i];
+			slot.pCam = camList.GetByIndex(i);
+			slot.index = i;
+			slot.metadataFile = NULL;
+			slot.grabbedImages = 0;
+			slot.incompleteImages = 0;
+			slot.savedImages = 0;
+			slot.missedImages = 0;
+			slot.softwareTriggered = false;
+			slot.statsValid = false;
+			slot.replay = NULL;
+			slot.state.store(CAMERA_STREAMING);
+
+			// Retrieve device serial number for filename
+			slot.serialNumber = "";
+			CStringPtr ptrStringSerial = slot.pCam->GetTLDeviceNodeMap().GetNode("DeviceSerialNumber");
+			if (IsAvailable(ptrStringSerial) && IsReadable(ptrStringSerial))
+			{
+				slot.serialNumber = ptrStringSerial->GetValue();
+				cout << "Camera " << i << " serial number set to " << slot.serialNumber << "..." << endl;
+			}
+
+			// Cache configuration for recovery
+			CacheCameraConfiguration(slot.pCam->GetNodeMap(), slot);
+		}
+
 		// Acquire images on all cameras
-		result = result | AcquireImages(camList);
+		if (controlAddress.empty())
+		{
+			result = result | AcquireImages(system, cameras);
+		}
+		else
+		{
+			result = result | RunDaemon(system, cameras, controlAddress);
+		}
 
 		// Reset trigger for each camera
-		for (int i = 0; i < camList.GetSize(); i++)
+		for (unsigned int i = 0; i < cameras.size(); i++)
 		{
+			// Skip cameras that were lost during acquisition
+			if (cameras[i].state.load() != CAMERA_STREAMING)
+			{
+				continue;
+			}
 			// Select camera
-			pCam = camList.GetByIndex(i);
+			pCam = cameras[i].pCam;
 			// Retrieve TL device nodemap
 			INodeMap & nodeMapTLDevice = pCam->GetTLDeviceNodeMap();
 			// Reset trigger
 			result = result | ResetTrigger(nodeMapTLDevice);
 		}
 
-		// Deinitialize each camera
-		for (int i = 0; i < camList.GetSize(); i++)
+		// Disable chunk data and deinitialize each camera
+		for (unsigned int i = 0; i < cameras.size(); i++)
 		{
+			if (cameras[i].state.load() != CAMERA_STREAMING)
+			{
+				continue;
+			}
 			// Select camera
-			pCam = camList.GetByIndex(i);
+			pCam = cameras[i].pCam;
+			// Disable chunk data
+			result = result | DisableChunkData(pCam->GetNodeMap());
 			// Deinitialize camera
 			pCam->DeInit();
 		}
@@ -891,8 +3727,44 @@ int RunMultipleCameras(CameraList camList)
 
 // Example entry point; please see Enumeration example for more in-depth 
 // comments on preparing and cleaning up the system.
-int main(int /*argc*/, char** /*argv*/)
+//
+// Usage: Trigger [--daemon [control address]]
+int main(int argc, char** argv)
 {
+	// Without arguments the example runs interactively; --daemon keeps the
+	// cameras streaming and serves the control socket instead.
+	string controlAddress;
+	if (argc > 1 && string(argv[1]) == "--daemon")
+	{
+		controlAddress = argc > 2 ? argv[2] : k_defaultControlAddress;
+		interactiveMode = false;
+	}
+
+	// --replay [speed] <segment>... streams a recorded session instead of
+	// the cameras; a speed of 0 replays as fast as possible.
+	double replaySpeed = k_defaultReplaySpeed;
+	vector<string> replaySegments;
+	if (argc > 1 && string(argv[1]) == "--replay")
+	{
+		replayMode = true;
+		int first = 2;
+		char * end = NULL;
+		if (argc > 2 && (replaySpeed = strtod(argv[2], &end), *end == '\0'))
+		{
+			first = 3;
+		}
+		else
+		{
+			replaySpeed = k_defaultReplaySpeed;
+		}
+		replaySegments.assign(argv + first, argv + argc);
+		if (replaySegments.empty())
+		{
+			cout << "Usage: Trigger --replay [speed] <segment.seg>..." << endl;
+			return -1;
+		}
+	}
+
 	// Since this application saves images in the current folder
 	// we must ensure that we have permission to write to this folder.
 	// If we do not have permission, fail right away.
@@ -902,8 +3774,11 @@ int main(int /*argc*/, char** /*argv*/)
 		cout << "Failed to create file in current folder.  Please check "
 			"permissions."
 			<< endl;
-		cout << "Press Enter to exit..." << endl;
-		getchar();
+		if (interactiveMode)
+		{
+			cout << "Press Enter to exit..." << endl;
+			getchar();
+		}
 		return -1;
 	}
 	fclose(tempFile);
@@ -920,6 +3795,21 @@ int main(int /*argc*/, char** /*argv*/)
 	// Retrieve list of cameras from the system
 	CameraList camList = system->GetCameras();
 
+	// A replay needs no cameras
+	if (replayMode)
+	{
+		result = RunReplay(system, replaySegments, replaySpeed);
+
+		camList.Clear();
+		system->ReleaseInstance();
+		if (interactiveMode)
+		{
+			cout << "Done! Press Enter to exit..." << endl;
+			getchar();
+		}
+		return result;
+	}
+
 	unsigned int numCameras = camList.GetSize();
 
 	cout << "Number of cameras detected: " << numCameras << endl << endl;
@@ -932,8 +3822,11 @@ int main(int /*argc*/, char** /*argv*/)
 		// Release system
 		system->ReleaseInstance();
 		cout << "Not enough cameras!" << endl;
-		cout << "Done! Press Enter to exit..." << endl;
-		getchar();
+		if (interactiveMode)
+		{
+			cout << "Done! Press Enter to exit..." << endl;
+			getchar();
+		}
 		return -1;
 	}
 
@@ -958,12 +3851,25 @@ int main(int /*argc*/, char** /*argv*/)
 			return err;
 		}
 
+		// Configure chunk data
+		err = ConfigureChunkData(nodeMap);
+		if (err < 0)
+		{
+			return err;
+		}
+
 	}
 
+	// Register for device arrival and removal events
+	system->RegisterInterfaceEvent(deviceEventHandler);
+
 	// Run example on all cameras
 	cout << endl << "Running example for all cameras..." << endl;
 
-	result = RunMultipleCameras(camList);
+	result = RunMultipleCameras(system, camList, controlAddress);
+
+	// Unregister device events
+	system->UnregisterInterfaceEvent(deviceEventHandler);
 
 	cout << "Example complete..." << endl << endl;
 
@@ -981,8 +3887,11 @@ int main(int /*argc*/, char** /*argv*/)
 	// Release system
 	system->ReleaseInstance();
 
-	cout << endl << "Done! Press Enter to exit..." << endl;
-	getchar();
+	if (interactiveMode)
+	{
+		cout << endl << "Done! Press Enter to exit..." << endl;
+		getchar();
+	}
 
 	return result;
 }
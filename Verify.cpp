@@ -0,0 +1,478 @@
+//=============================================================================
+// Verify.cpp
+//
+// Integrity check for the segmented recordings written by Trigger.cpp:
+//
+//     Verify [--threads n] <segment.seg>...
+//
+// Every frame of a version 2 segment carries the CRC32C of its image data in
+// its frame header, and finalized segments repeat it in their index. The
+// verifier maps the segments and recomputes the checksums of all frames on a
+// pool of threads, which pull chunks of frames from a shared counter so the
+// disk stays busy. Damaged frames are reported by camera and frame ID: a data
+// checksum that does not match, or an index entry that disagrees with its
+// frame header or has none at its offset. Before its frames, every segment
+// gets a structural check: an index is held against the segment's length and
+// whole-file checksum, and a scan that stops before the end of a segment is
+// reported with the offset of the damage, after which the verifier picks up
+// the frames that follow. The whole-file checksum of a finalized segment is
+// chained from the checksums of the ranges of its frames, taken in the frame
+// pass, so the segment is read once and on all threads.
+//=============================================================================
+
+#include "RecordingReader.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+// Frames handed to a worker at a time.
+const size_t k_verifyChunkFrames = 16;
+
+// Bytes checksummed at a time when checking a whole segment apart from its
+// frames.
+const size_t k_verifyChecksumBytes = 64 * 1024 * 1024;
+
+struct VerifySegment
+{
+	string path;
+	string serialNumber;
+	unique_ptr<SegmentReader> reader;
+
+	// True if the frames of the index cover the whole file in order. The
+	// checksum of each frame's range, up to the next frame, is then kept
+	// for the whole-file checksum.
+	bool chainChecksum;
+	vector<uint32_t> rangeChecksums;
+};
+
+// This class holds the state shared by the verify workers.
+class VerifyJob
+{
+public:
+	explicit VerifyJob(vector<VerifySegment> & segments) : m_segments(segments), m_nextSegment(0), m_nextChunk(0), m_verifiedFrames(0), m_verifiedBytes(0),
+		m_damagedFrames(0), m_damagedSegments(0)
+	{
+		for (size_t i = 0; i < m_segments.size(); i++)
+		{
+			VerifySegment & segment = m_segments[i];
+			segment.chainChecksum = false;
+			if (!segment.reader->HasChecksums())
+			{
+				continue;
+			}
+			for (size_t j = 0; j < segment.reader->Frames().size(); j++)
+			{
+				m_frames.push_back(make_pair(i, j));
+			}
+			segment.chainChecksum = segment.reader->Indexed() && FramesCoverFile(segment);
+			segment.rangeChecksums.assign(segment.chainChecksum ? segment.reader->Frames().size() : 0, 0);
+		}
+	}
+
+	void RunWorker()
+	{
+		for (;;)
+		{
+			size_t segment = m_nextSegment.fetch_add(1);
+			if (segment >= m_segments.size())
+			{
+				break;
+			}
+			if (m_segments[segment].reader->HasChecksums())
+			{
+				VerifyStructure(m_segments[segment]);
+			}
+		}
+
+		for (;;)
+		{
+			size_t first = m_nextChunk.fetch_add(k_verifyChunkFrames);
+			if (first >= m_frames.size())
+			{
+				return;
+			}
+			size_t last = min(first + k_verifyChunkFrames, m_frames.size());
+			for (size_t n = first; n < last; n++)
+			{
+				VerifyFrame(m_segments[m_frames[n].first], m_frames[n].second);
+			}
+		}
+	}
+
+	// Completes the whole-file checksums chained from the frame pass, once
+	// all workers are done.
+	void VerifyChainedChecksums()
+	{
+		for (size_t i = 0; i < m_segments.size(); i++)
+		{
+			const VerifySegment & segment = m_segments[i];
+			if (!segment.chainChecksum)
+			{
+				continue;
+			}
+			const vector<SegmentFrame> & frames = segment.reader->Frames();
+			uint64_t prefix = frames.empty() ? segment.reader->IndexHeader().segmentSize : frames[0].offset;
+			uint32_t checksum = Crc32c(0, segment.reader->File().Data(), static_cast<size_t>(prefix));
+			for (size_t j = 0; j < frames.size(); j++)
+			{
+				checksum = Crc32cCombine(checksum, segment.rangeChecksums[j], RangeEnd(segment, j) - frames[j].offset);
+			}
+			CheckSegmentChecksum(segment, checksum);
+		}
+	}
+
+	// Records a damaged frame.
+	void Report(const VerifySegment & segment, const SegmentFrameHeader & header, const string & reason)
+	{
+		ostringstream line;
+		line << "Camera " << segment.serialNumber << " frame " << header.metadata.frameId << " (image " << header.metadata.imageCnt << ") in "
+			<< segment.path << ": " << reason;
+		Print(line.str());
+		m_damagedFrames++;
+	}
+
+	// Records a damaged frame known only from its index entry.
+	void Report(const VerifySegment & segment, const SegmentIndexEntry & entry, const string & reason)
+	{
+		ostringstream line;
+		line << "Camera " << segment.serialNumber << " frame " << entry.frameId << " (image " << entry.imageCnt << ") in "
+			<< segment.path << ": " << reason;
+		Print(line.str());
+		m_damagedFrames++;
+	}
+
+	// Records damage to the structure of a segment.
+	void Report(const VerifySegment & segment, const string & reason)
+	{
+		Print("Camera " + segment.serialNumber + " in " + segment.path + ": " + reason);
+		m_damagedSegments++;
+	}
+
+	size_t Frames() const { return m_frames.size(); }
+	uint64_t VerifiedFrames() const { return m_verifiedFrames.load(); }
+	uint64_t VerifiedBytes() const { return m_verifiedBytes.load(); }
+	uint64_t DamagedFrames() const { return m_damagedFrames.load(); }
+	uint64_t DamagedSegments() const { return m_damagedSegments.load(); }
+
+private:
+	void Print(const string & line)
+	{
+		lock_guard<mutex> lock(m_reportMutex);
+		cout << line << endl;
+	}
+
+	static bool EntryMatches(const SegmentIndexEntry & entry, const SegmentFrameHeader & header)
+	{
+		return entry.checksum == header.checksum && entry.frameId == header.metadata.frameId && entry.dataSize == header.dataSize;
+	}
+
+	// Returns the end of the range of a frame: the next frame, or the end of
+	// the segment.
+	static uint64_t RangeEnd(const VerifySegment & segment, size_t frameIndex)
+	{
+		const vector<SegmentFrame> & frames = segment.reader->Frames();
+		return frameIndex + 1 < frames.size() ? frames[frameIndex + 1].offset : segment.reader->IndexHeader().segmentSize;
+	}
+
+	// Returns true if the frames follow the segment header in order and do
+	// not overlap, so that their ranges cover the file.
+	static bool FramesCoverFile(const VerifySegment & segment)
+	{
+		const vector<SegmentFrame> & frames = segment.reader->Frames();
+		for (size_t j = 0; j < frames.size(); j++)
+		{
+			uint64_t begin = j > 0 ? frames[j - 1].offset + 1 : sizeof(SegmentHeader);
+			if (frames[j].offset < begin || frames[j].offset + sizeof(SegmentFrameHeader) + frames[j].header->dataSize > RangeEnd(segment, j))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void CheckSegmentChecksum(const VerifySegment & segment, uint32_t checksum)
+	{
+		if (checksum != segment.reader->IndexHeader().segmentChecksum)
+		{
+			ostringstream reason;
+			reason << "segment checksum " << hex << checksum << " does not match index " << segment.reader->IndexHeader().segmentChecksum;
+			Report(segment, reason.str());
+		}
+	}
+
+	// This function checks a segment against its index and the bytes that
+	// follow the last frame found by a scan.
+	void VerifyStructure(const VerifySegment & segment)
+	{
+		const SegmentReader & reader = *segment.reader;
+		if (reader.HasIndex())
+		{
+			VerifyIndex(segment);
+		}
+		else if (reader.IndexRejected())
+		{
+			Report(segment, "index unreadable, frames found by scan");
+		}
+		if (!reader.Indexed())
+		{
+			VerifyScanEnd(segment);
+		}
+	}
+
+	void VerifyIndex(const VerifySegment & segment)
+	{
+		const SegmentReader & reader = *segment.reader;
+		const SegmentIndexHeader & indexHeader = reader.IndexHeader();
+		const vector<SegmentIndexEntry> & entries = reader.IndexEntries();
+		const MappedFile & file = reader.File();
+
+		if (indexHeader.frameCount != entries.size())
+		{
+			ostringstream reason;
+			reason << "index lists " << indexHeader.frameCount << " frames but holds " << entries.size() << " entries, frames found by scan";
+			Report(segment, reason.str());
+		}
+		if (indexHeader.segmentSize != file.Size())
+		{
+			ostringstream reason;
+			reason << "index is for " << indexHeader.segmentSize << " bytes but segment has " << file.Size() << ", frames found by scan";
+			Report(segment, reason.str());
+		}
+
+		if (reader.Indexed())
+		{
+			for (size_t i = 0; i < reader.DamagedEntries().size(); i++)
+			{
+				const SegmentIndexEntry & entry = entries[reader.DamagedEntries()[i]];
+				ostringstream reason;
+				reason << "no frame at byte " << entry.offset;
+				Report(segment, entry, reason.str());
+			}
+		}
+		else
+		{
+			// The frames were found by scan; look up every entry by its
+			// offset, so that frames the scan did not reach are named too
+			for (size_t i = 0; i < entries.size(); i++)
+			{
+				SegmentFrame frame;
+				ostringstream reason;
+				if (!reader.FrameAt(entries[i].offset, frame))
+				{
+					reason << "no frame at byte " << entries[i].offset;
+					Report(segment, entries[i], reason.str());
+				}
+				else if (!EntryMatches(entries[i], *frame.header))
+				{
+					reason << "index entry does not match frame header at byte " << entries[i].offset;
+					Report(segment, entries[i], reason.str());
+				}
+			}
+		}
+
+		// Segments whose frames do not cover the file are checksummed here
+		if (!segment.chainChecksum && indexHeader.segmentSize <= file.Size())
+		{
+			uint32_t checksum = 0;
+			for (uint64_t offset = 0; offset < indexHeader.segmentSize; offset += k_verifyChecksumBytes)
+			{
+				size_t size = static_cast<size_t>(min<uint64_t>(k_verifyChecksumBytes, indexHeader.segmentSize - offset));
+				checksum = Crc32c(checksum, file.Data() + offset, size);
+			}
+			CheckSegmentChecksum(segment, checksum);
+		}
+	}
+
+	// This function reports a scan that stopped before the end of the
+	// segment's data, and verifies the frames that follow the damage.
+	void VerifyScanEnd(const VerifySegment & segment)
+	{
+		const SegmentReader & reader = *segment.reader;
+		const uint8_t * data = reader.File().Data();
+		uint64_t size = reader.File().Size();
+
+		// An unfinalized segment is zero from the end of its last frame
+		static const uint8_t zeros[4096] = {};
+		uint64_t offset = reader.ScanEnd();
+		while (offset + sizeof(zeros) <= size && memcmp(data + offset, zeros, sizeof(zeros)) == 0)
+		{
+			offset += sizeof(zeros);
+		}
+		while (offset < size && data[offset] == 0)
+		{
+			offset++;
+		}
+		if (offset >= size)
+		{
+			return;
+		}
+
+		ostringstream reason;
+		reason << "frames end at byte " << reader.ScanEnd() << " but data follows at byte " << offset;
+		Report(segment, reason.str());
+
+		uint64_t recovered = 0;
+		SegmentFrame frame;
+		uint64_t next = max<uint64_t>(reader.ScanEnd() + k_segmentAlignment, offset & ~static_cast<uint64_t>(k_segmentAlignment - 1));
+		while (reader.FindFrame(next, frame))
+		{
+			const SegmentFrameHeader & header = *frame.header;
+			uint32_t checksum = Crc32c(0, frame.data, header.dataSize);
+			if (checksum != header.checksum)
+			{
+				ostringstream frameReason;
+				frameReason << "image data checksum " << hex << checksum << " does not match " << header.checksum << " at byte " << dec << frame.offset;
+				Report(segment, header, frameReason.str());
+			}
+			else
+			{
+				recovered++;
+			}
+			m_verifiedFrames++;
+			m_verifiedBytes += header.dataSize;
+			next = frame.offset + SegmentAlign(sizeof(SegmentFrameHeader) + static_cast<uint64_t>(header.dataSize));
+		}
+
+		ostringstream line;
+		line << "Camera " << segment.serialNumber << " in " << segment.path << ": intact frames after the damage: " << recovered;
+		Print(line.str());
+	}
+
+	void VerifyFrame(VerifySegment & segment, size_t frameIndex)
+	{
+		const SegmentFrame & frame = segment.reader->Frames()[frameIndex];
+		const SegmentFrameHeader & header = *frame.header;
+
+		uint32_t checksum = Crc32c(0, frame.data, header.dataSize);
+		if (segment.chainChecksum)
+		{
+			// Header, data and whatever follows up to the next frame
+			uint64_t dataEnd = frame.offset + sizeof(SegmentFrameHeader) + header.dataSize;
+			uint32_t range = Crc32cCombine(Crc32c(0, frame.header, sizeof(SegmentFrameHeader)), checksum, header.dataSize);
+			segment.rangeChecksums[frameIndex] = Crc32c(range, frame.data + header.dataSize, static_cast<size_t>(RangeEnd(segment, frameIndex) - dataEnd));
+		}
+		if (checksum != header.checksum)
+		{
+			ostringstream reason;
+			reason << "image data checksum " << hex << checksum << " does not match " << header.checksum;
+			Report(segment, header, reason.str());
+		}
+		else if (frame.entry != NULL && !EntryMatches(*frame.entry, header))
+		{
+			Report(segment, header, "index entry does not match frame header");
+		}
+
+		m_verifiedFrames++;
+		m_verifiedBytes += header.dataSize;
+	}
+
+	vector<VerifySegment> & m_segments;
+	vector<pair<size_t, size_t> > m_frames;
+	atomic<size_t> m_nextSegment;
+	atomic<size_t> m_nextChunk;
+
+	mutex m_reportMutex;
+	atomic<uint64_t> m_verifiedFrames;
+	atomic<uint64_t> m_verifiedBytes;
+	atomic<uint64_t> m_damagedFrames;
+	atomic<uint64_t> m_damagedSegments;
+};
+
+int main(int argc, char** argv)
+{
+	unsigned int numThreads = thread::hardware_concurrency();
+	vector<string> segmentPaths;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--threads" && i + 1 < argc)
+		{
+			numThreads = static_cast<unsigned int>(atoi(argv[++i]));
+		}
+		else
+		{
+			segmentPaths.push_back(arg);
+		}
+	}
+
+	if (segmentPaths.empty())
+	{
+		cout << "Usage: Verify [--threads n] <segment.seg>..." << endl;
+		return -1;
+	}
+	if (numThreads == 0)
+	{
+		numThreads = 1;
+	}
+
+	int result = 0;
+
+	// Map every segment and check its structure
+	vector<VerifySegment> segments;
+	for (size_t i = 0; i < segmentPaths.size(); i++)
+	{
+		VerifySegment segment;
+		segment.path = segmentPaths[i];
+		segment.reader.reset(new SegmentReader());
+		if (!segment.reader->Open(segment.path))
+		{
+			cout << segment.path << ": not a readable segment" << endl;
+			result = -1;
+			continue;
+		}
+
+		char serialNumber[sizeof(segment.reader->Header().serialNumber) + 1];
+		memcpy(serialNumber, segment.reader->Header().serialNumber, sizeof(segment.reader->Header().serialNumber));
+		serialNumber[sizeof(serialNumber) - 1] = '\0';
+		segment.serialNumber = serialNumber;
+
+		if (!segment.reader->HasIndex() && !segment.reader->IndexRejected())
+		{
+			cout << segment.path << ": not finalized, frames found by scan" << endl;
+		}
+		if (!segment.reader->HasChecksums())
+		{
+			cout << segment.path << ": written without checksums, skipped" << endl;
+		}
+		segments.push_back(move(segment));
+	}
+
+	VerifyJob job(segments);
+	cout << "Verifying " << job.Frames() << " frames in " << segments.size() << " segments on " << numThreads << " threads..." << endl;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	vector<thread> workers;
+	for (unsigned int i = 0; i < numThreads; i++)
+	{
+		workers.push_back(thread(&VerifyJob::RunWorker, &job));
+	}
+	for (unsigned int i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+	job.VerifyChainedChecksums();
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << "Verified " << job.VerifiedFrames() << " frames, " << job.VerifiedBytes() / 1000000 << " MB in " << seconds << " s ("
+		<< (seconds > 0.0 ? job.VerifiedBytes() / seconds / 1e6 : 0.0) << " MB/s), " << job.DamagedFrames() << " damaged, "
+		<< job.DamagedSegments() << " segment errors" << endl;
+
+	if (job.DamagedFrames() > 0 || job.DamagedSegments() > 0)
+	{
+		result = -1;
+	}
+	return result;
+}